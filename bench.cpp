@@ -0,0 +1,552 @@
+#include "func.hpp"
+
+// Неинтерактивный бенчмарк SpGEMM: C = A * A на сгенерированных матрицах и файлах A*.txt
+// с прогревом, повторными замерами и сравнением с mkl_sparse_spmm. Результаты пишутся
+// в CSV и JSON для отслеживания регрессий между версиями.
+//
+// С --triangles для каждой квадратной матрицы дополнительно сравнивается подсчет
+// треугольников маскированным умножением L ⊙ (L * L) и полным L * L с фильтром по L.
+// С --pipeline файлы матриц читаются и возводятся в квадрат последовательно и конвейером
+// multiply_pipeline, в котором чтение следующего файла идет во время умножения.
+// С --reorder для каждой матрицы замеряется C = A * A после переупорядочивания RCM, по степени
+// и по длине строк: только умножение на заранее переставленных матрицах и полный вызов
+// sparse_matrix_multiply_reordered с перестановкой входа и обратной перестановкой C.
+// С --bsr на блочно-ленточных матрицах (сборка МКЭ с 2..8 степенями свободы в узле)
+// сравниваются умножение и SpMV в CSR и в BSR с автоматически выбранным размером блока.
+// С --chain для квадратных матриц A^4 считается циклом sparse_matrix_multiply и через
+// sparse_matrix_power, а тройное произведение R * A * R^T (R - случайное сужение на
+// восьмую часть строк) - слева направо и через sparse_matrix_chain_multiply; результаты
+// сравниваются с последовательными умножениями.
+// С --single-pass для каждой матрицы C = A * A считается двухэтапным умножением и
+// однопроходным с ареной, общей для всех повторов: время вызова и ядер, число строк
+// сверх оценки и число выделений памяти ареной.
+// С --batch N сравнивается пакетное умножение N пар матриц 5x5 с N отдельными вызовами.
+//
+// Запуск: sycl-bench [--reps N] [--warmup N] [--quick] [--gpu] [--triangles] [--batch N] [--pipeline]
+//                    [--reorder] [--bsr] [--chain] [--single-pass] [--csv file] [--json file] [matrix files...]
+
+struct BenchCase {
+    std::string name;
+    std::string kind;
+    CSRMatrix A;
+};
+
+struct BenchResult {
+    std::string name, kind;
+    int rows, cols;
+    size_t nnz_A, products, nnz_C;
+    double sycl_median, sycl_p95, mkl_median, mkl_p95;
+};
+
+// Перцентиль p (0..1) по выборке времен
+static double percentile(std::vector<double> times, double p) {
+    std::sort(times.begin(), times.end());
+    size_t k = static_cast<size_t>(std::ceil(p * times.size()));
+    return times[std::min(times.size() - 1, k > 0 ? k - 1 : 0)];
+}
+
+// Число умножений в A * B (flops = 2 * products)
+static size_t count_products(const CSRMatrix& A, const CSRMatrix& B) {
+    size_t products = 0;
+    for (size_t k = 0; k < A.col_ind.size(); ++k) {
+        products += B.row_ptr[A.col_ind[k] + 1] - B.row_ptr[A.col_ind[k]];
+    }
+    return products;
+}
+
+template <class F>
+static std::vector<double> measure(F run, int warmup, int reps) {
+    for (int r = 0; r < warmup; ++r) {
+        run();
+    }
+    std::vector<double> times;
+    for (int r = 0; r < reps; ++r) {
+        auto start = std::chrono::high_resolution_clock::now();
+        run();
+        auto end = std::chrono::high_resolution_clock::now();
+        times.push_back(std::chrono::duration<double>(end - start).count());
+    }
+    return times;
+}
+
+static bool file_exists(const std::string& filename) {
+    return std::ifstream(filename).good();
+}
+
+static std::vector<BenchCase> make_cases(bool quick, const std::vector<std::string>& files) {
+    std::vector<BenchCase> cases;
+
+    std::vector<int> sizes = quick ? std::vector<int>{2000} : std::vector<int>{2000, 8000, 32000};
+    for (int n : sizes) {
+        for (int per_row : {4, 16}) {
+            cases.push_back({"uniform_n" + std::to_string(n) + "_k" + std::to_string(per_row), "uniform",
+                             generate_uniform_random(n, n, static_cast<double>(per_row) / n)});
+        }
+    }
+
+    std::vector<int> band_sizes = quick ? std::vector<int>{10000} : std::vector<int>{10000, 100000};
+    for (int n : band_sizes) {
+        for (int half : {1, 4}) {
+            cases.push_back({"banded_n" + std::to_string(n) + "_w" + std::to_string(2 * half + 1), "banded",
+                             generate_banded(n, half)});
+        }
+    }
+
+    std::vector<int> scales = quick ? std::vector<int>{10} : std::vector<int>{12, 14};
+    for (int scale : scales) {
+        cases.push_back({"rmat_s" + std::to_string(scale) + "_e8", "rmat", generate_rmat(scale, 8)});
+    }
+
+    for (const auto& filename : files) {
+        cases.push_back({filename, "file", read_matrix(filename)});
+    }
+    return cases;
+}
+
+static BenchResult run_case(BenchCase& c, queue& q, int warmup, int reps) {
+    CSRMatrix& A = c.A;
+    BenchResult r = {c.name, c.kind, A.rows, A.cols, A.col_ind.size(), count_products(A, A), 0, 0, 0, 0, 0};
+
+    CSRMatrix C;
+    auto sycl_times = measure([&] { sparse_matrix_multiply(A, A, C, q); }, warmup, reps);
+    r.nnz_C = C.col_ind.size();
+    r.sycl_median = percentile(sycl_times, 0.5);
+    r.sycl_p95 = percentile(sycl_times, 0.95);
+
+    sparse_matrix_t A_mkl = nullptr;
+    if (mkl_sparse_d_create_csr(&A_mkl, SPARSE_INDEX_BASE_ZERO, A.rows, A.cols, A.row_ptr.data(),
+                                A.row_ptr.data() + 1, A.col_ind.data(), A.values.data()) != SPARSE_STATUS_SUCCESS) {
+        throw std::runtime_error("Ошибка при создании CSR матрицы MKL");
+    }
+    auto mkl_times = measure([&] {
+        sparse_matrix_t C_mkl = nullptr;
+        mkl_sparse_spmm(SPARSE_OPERATION_NON_TRANSPOSE, A_mkl, A_mkl, &C_mkl);
+        mkl_sparse_destroy(C_mkl);
+    }, warmup, reps);
+    mkl_sparse_destroy(A_mkl);
+    r.mkl_median = percentile(mkl_times, 0.5);
+    r.mkl_p95 = percentile(mkl_times, 0.95);
+
+    return r;
+}
+
+// Сумма элементов C в позициях L: фильтр полного произведения для сравнения с маской
+static size_t sum_masked(const CSRMatrix& C, const CSRMatrix& L) {
+    double sum = 0;
+    for (int i = 0; i < L.rows; ++i) {
+        int p = C.row_ptr[i];
+        for (int r = L.row_ptr[i]; r < L.row_ptr[i + 1]; ++r) {
+            while (p < C.row_ptr[i + 1] && C.col_ind[p] < L.col_ind[r]) {
+                ++p;
+            }
+            if (p < C.row_ptr[i + 1] && C.col_ind[p] == L.col_ind[r]) {
+                sum += C.values[p];
+            }
+        }
+    }
+    return static_cast<size_t>(std::llround(sum));
+}
+
+// Подсчет треугольников: маскированное умножение в обеих формах и с автоматическим
+// выбором против полного L * L с последующим фильтром. L строится вне замеров для всех
+// вариантов; count_triangles (с построением L) проверяется отдельно без замера.
+static void run_triangles(BenchCase& c, queue& q, int warmup, int reps) {
+    if (c.A.rows != c.A.cols) {
+        return;
+    }
+    CSRMatrix L = undirected_lower_triangle(c.A);
+    size_t counts[4] = {};
+    double medians[4] = {};
+    const MaskedSpGEMMKernel kernels[3] = {MaskedSpGEMMKernel::automatic, MaskedSpGEMMKernel::dot,
+                                           MaskedSpGEMMKernel::gustavson};
+    for (int k = 0; k < 3; ++k) {
+        medians[k] = percentile(measure([&] {
+            CSRMatrix C;
+            sparse_matrix_multiply_masked(L, L, L, C, q, kernels[k]);
+            double sum = 0;
+            for (double v : C.values) {
+                sum += v;
+            }
+            counts[k] = static_cast<size_t>(std::llround(sum));
+        }, warmup, reps), 0.5);
+    }
+    medians[3] = percentile(measure([&] {
+        CSRMatrix C;
+        sparse_matrix_multiply(L, L, C, q);
+        counts[3] = sum_masked(C, L);
+    }, warmup, reps), 0.5);
+
+    bool same = counts[0] == counts[3] && counts[1] == counts[3] && counts[2] == counts[3] &&
+                count_triangles(c.A, q) == counts[3];
+    std::cout << std::left << std::setw(28) << c.name << std::right << std::setw(12) << counts[0]
+              << std::setw(12) << medians[0] << std::setw(12) << medians[1] << std::setw(12) << medians[2]
+              << std::setw(12) << medians[3] << std::setw(10) << medians[3] / medians[0]
+              << (same ? "" : "  MISMATCH") << std::endl;
+}
+
+// Ускорение от переупорядочивания: базовое умножение против умножения переставленных
+// матриц (kernel) и полного sparse_matrix_multiply_reordered (end-to-end), результат
+// которого после обратной перестановки сравнивается с базовым
+static void run_reorder(BenchCase& c, queue& q, int warmup, int reps) {
+    CSRMatrix& A = c.A;
+    CSRMatrix C_base, C;
+    double base = percentile(measure([&] { sparse_matrix_multiply(A, A, C_base, q); }, warmup, reps), 0.5);
+    std::cout << std::left << std::setw(28) << c.name << std::right << std::setw(12) << base;
+    bool same = true;
+
+    for (Reordering method : {Reordering::rcm, Reordering::degree, Reordering::row_length}) {
+        if (A.rows != A.cols && method != Reordering::row_length) {
+            std::cout << std::setw(10) << "-" << std::setw(10) << "-";
+            continue;
+        }
+        // A' = P A Q^T, B' = Q A R^T, как внутри sparse_matrix_multiply_reordered
+        MatrixPermutation<int> perm = compute_reordering(CSRView(A), method);
+        MatrixPermutation<int> b_perm = {perm.cols, A.rows == A.cols ? perm.cols : std::vector<int>()};
+        CSRMatrix A_perm = permute_matrix(A, perm);
+        CSRMatrix B_perm = permute_matrix(A, b_perm);
+        double kernel = percentile(measure([&] { sparse_matrix_multiply(A_perm, B_perm, C, q); }, warmup, reps), 0.5);
+        double full = percentile(measure([&] { sparse_matrix_multiply_reordered(A, A, C, q, method); }, warmup, reps), 0.5);
+        same = same && same_matrix(C, C_base);
+        std::cout << std::setw(10) << base / kernel << std::setw(10) << base / full;
+    }
+    std::cout << (same ? "" : "  MISMATCH") << std::endl;
+}
+
+// CSR против BSR на матрицах из плотных блоков: время C = A * A и y = A * x, размер
+// блока и заполнение, выбранные detect_block_size
+static void run_bsr(bool quick, queue& q, int warmup, int reps) {
+    int nodes = quick ? 2000 : 20000;
+    for (int block : {2, 3, 4, 6, 8}) {
+        CSRMatrix A = generate_block_banded(nodes / block, 2, block);
+        BSRMatrix S = csr_to_bsr(A);
+        std::vector<double> x(A.cols, 1.0), y;
+
+        CSRMatrix C;
+        BSRMatrix C_bsr;
+        std::vector<double> y_bsr;
+        double csr_mm = percentile(measure([&] { sparse_matrix_multiply(A, A, C, q); }, warmup, reps), 0.5);
+        double bsr_mm = percentile(measure([&] { sparse_matrix_multiply(S, S, C_bsr, q); }, warmup, reps), 0.5);
+        double csr_mv = percentile(measure([&] { sparse_matrix_vector_multiply(A, x, y, q); }, warmup, reps), 0.5);
+        double bsr_mv = percentile(measure([&] { sparse_matrix_vector_multiply(S, x, y_bsr, q); }, warmup, reps), 0.5);
+
+        // Преобразование туда и обратно и результаты BSR в сравнении с CSR
+        bool same = same_matrix(bsr_to_csr(S), A) && same_matrix(bsr_to_csr(C_bsr), C) && y_bsr.size() == y.size();
+        for (size_t i = 0; same && i < y.size(); ++i) {
+            same = std::fabs(y_bsr[i] - y[i]) <= eps * std::max(1.0, std::fabs(y[i]));
+        }
+
+        std::cout << std::left << std::setw(28) << ("block_banded_b" + std::to_string(block)) << std::right
+                  << std::setw(8) << S.block << std::setw(8) << S.fill_ratio() << std::setw(12) << csr_mm
+                  << std::setw(12) << bsr_mm << std::setw(10) << csr_mm / bsr_mm << std::setw(12) << csr_mv
+                  << std::setw(12) << bsr_mv << std::setw(10) << csr_mv / bsr_mv << (same ? "" : "  MISMATCH")
+                  << std::endl;
+    }
+}
+
+// Степень и цепочка: отдельные вызовы с копированием промежуточных результатов на хост
+// против вычисления на устройстве с выбором порядка умножений; результаты сравниваются
+static void run_chain(BenchCase& c, queue& q, int warmup, int reps) {
+    CSRMatrix& A = c.A;
+    if (A.rows != A.cols || A.rows < 8) {
+        return;
+    }
+    CSRMatrix C, C_loop;
+    double loop_power = percentile(measure([&] {
+        CSRMatrix P = A;
+        for (int k = 1; k < 4; ++k) {
+            sparse_matrix_multiply(P, A, C, q);
+            P = std::move(C);
+        }
+        C_loop = std::move(P);
+    }, warmup, reps), 0.5);
+    double power = percentile(measure([&] { sparse_matrix_power(A, 4, C, q); }, warmup, reps), 0.5);
+    bool same = same_matrix(C, C_loop);
+
+    CSRMatrix R = generate_uniform_random(A.rows / 8, A.cols, 4.0 / A.cols);
+    CSRMatrix P = sparse_matrix_transpose(R, q);
+    std::vector<CSRView> factors = {R, A, P};
+    double loop_chain = percentile(measure([&] {
+        CSRMatrix RA;
+        sparse_matrix_multiply(R, A, RA, q);
+        sparse_matrix_multiply(RA, P, C_loop, q);
+    }, warmup, reps), 0.5);
+    double chain = percentile(measure([&] { sparse_matrix_chain_multiply(factors, C, q); }, warmup, reps), 0.5);
+    same = same && same_matrix(C, C_loop);
+
+    std::cout << std::left << std::setw(28) << c.name << std::right << std::setw(12) << loop_power
+              << std::setw(12) << power << std::setw(10) << loop_power / power << std::setw(12) << loop_chain
+              << std::setw(12) << chain << std::setw(10) << loop_chain / chain << "  "
+              << chain_multiply_order(factors) << (same ? "" : "  MISMATCH") << std::endl;
+}
+
+// Двухэтапное умножение против однопроходного; kernel - ядра символьного и численного
+// этапов (для однопроходного - однопроходное ядро и сжатие C)
+static void run_single_pass(BenchCase& c, queue& q, DeviceArena& arena, int warmup, int reps) {
+    CSRMatrix& A = c.A;
+    CSRMatrix C, C_two_pass;
+    MultiplyStats two_pass, one_pass;
+    double two_pass_time = percentile(measure([&] {
+        two_pass = sparse_matrix_multiply(A, A, C_two_pass, q);
+    }, warmup, reps), 0.5);
+    size_t allocations = arena.device_allocations();
+    double one_pass_time = percentile(measure([&] {
+        one_pass = sparse_matrix_multiply_single_pass(A, A, C, arena);
+    }, warmup, reps), 0.5);
+
+    std::cout << std::left << std::setw(28) << c.name << std::right << std::setw(12) << two_pass_time
+              << std::setw(12) << one_pass_time << std::setw(10) << two_pass_time / one_pass_time << std::setw(12)
+              << two_pass.symbolic + two_pass.numeric << std::setw(12) << one_pass.numeric << std::setw(10)
+              << one_pass.overflow_rows << std::setw(8) << arena.device_allocations() - allocations
+              << (same_matrix(C, C_two_pass) ? "" : "  MISMATCH") << std::endl;
+}
+
+// Пакет из count пар случайных матриц 5x5 (как блоки поэлементной сборки): пакетный
+// вызов против отдельного sparse_matrix_multiply на каждую пару
+static void run_batch(size_t count, queue& q, int warmup, int reps) {
+    std::vector<CSRMatrix> As, Bs;
+    CSRBatch A, B;
+    for (size_t b = 0; b < count; ++b) {
+        As.push_back(generate_uniform_random(5, 5, 0.6, static_cast<unsigned>(2 * b + 1)));
+        Bs.push_back(generate_uniform_random(5, 5, 0.6, static_cast<unsigned>(2 * b + 2)));
+        A.push_back(As.back());
+        B.push_back(Bs.back());
+    }
+
+    CSRBatch C;
+    double batched = percentile(measure([&] { sparse_matrix_multiply_batched(A, B, C, q); }, warmup, reps), 0.5);
+    double separate = percentile(measure([&] {
+        CSRMatrix C_b;
+        for (size_t b = 0; b < count; ++b) {
+            sparse_matrix_multiply(As[b], Bs[b], C_b, q);
+        }
+    }, warmup, reps), 0.5);
+
+    bool same = C.size() == count;
+    for (size_t b = 0; same && b < count; ++b) {
+        CSRMatrix C_b;
+        sparse_matrix_multiply(As[b], Bs[b], C_b, q);
+        same = same_matrix(C.matrix(b), C_b);
+    }
+
+    std::cout << std::endl << "batch of " << count << " 5x5 products: batched " << batched << " s, separate "
+              << separate << " s, speedup " << separate / batched << ", nnz(C) " << C.col_ind.size()
+              << (same ? "" : "  MISMATCH") << std::endl;
+}
+
+// Чтение и умножение A_i * A_i по списку файлов: последовательно и конвейером; результаты
+// конвейера и асинхронного умножения сравниваются с последовательными
+static void run_pipeline(const std::vector<std::string>& files, queue& q, int warmup, int reps) {
+    if (files.empty()) {
+        return;
+    }
+    std::vector<CSRMatrix> expected(files.size());
+    double sequential = percentile(measure([&] {
+        for (size_t i = 0; i < files.size(); ++i) {
+            CSRMatrix A = read_matrix(files[i]);
+            sparse_matrix_multiply(A, A, expected[i], q);
+        }
+    }, warmup, reps), 0.5);
+
+    MultiplyStats stats;
+    bool same = true;
+    double pipelined = percentile(measure([&] {
+        stats = multiply_pipeline<int, double>(
+            files.size(),
+            [&](size_t i) {
+                CSRMatrix A = read_matrix(files[i]);
+                return std::make_pair(A, A);
+            },
+            [&](size_t i, CSRMatrix& C) { same = same && same_matrix(C, expected[i]); }, q);
+    }, warmup, reps), 0.5);
+
+    CSRMatrix A = read_matrix(files[0]);
+    CSRMatrix C;
+    sparse_matrix_multiply_async(A, A, C, q).get();
+    same = same && same_matrix(C, expected[0]);
+
+    std::cout << std::endl << "pipeline of " << files.size() << " files: sequential " << sequential
+              << " s, pipelined " << pipelined << " s (load wait " << stats.load << " s), speedup "
+              << sequential / pipelined << (same ? "" : "  MISMATCH") << std::endl;
+}
+
+static double gflops(size_t products, double seconds) {
+    return seconds > 0 ? 2.0 * products / seconds * 1e-9 : 0;
+}
+
+static double compression(const BenchResult& r) {
+    return r.nnz_C > 0 ? static_cast<double>(r.products) / r.nnz_C : 0;
+}
+
+static void write_csv(const std::vector<BenchResult>& results, const std::string& filename) {
+    std::ofstream out(filename);
+    out << "name,kind,rows,cols,nnz_A,products,nnz_C,compression,sycl_median_s,sycl_p95_s,sycl_gflops,"
+           "mkl_median_s,mkl_p95_s,mkl_gflops,speedup_vs_mkl\n";
+    out << std::setprecision(6);
+    for (const auto& r : results) {
+        out << r.name << "," << r.kind << "," << r.rows << "," << r.cols << "," << r.nnz_A << ","
+            << r.products << "," << r.nnz_C << "," << compression(r) << ","
+            << r.sycl_median << "," << r.sycl_p95 << "," << gflops(r.products, r.sycl_median) << ","
+            << r.mkl_median << "," << r.mkl_p95 << "," << gflops(r.products, r.mkl_median) << ","
+            << r.mkl_median / r.sycl_median << "\n";
+    }
+}
+
+static void write_json(const std::vector<BenchResult>& results, const std::string& device, const std::string& filename) {
+    std::ofstream out(filename);
+    out << std::setprecision(6);
+    out << "{\n  \"device\": \"" << device << "\",\n  \"results\": [\n";
+    for (size_t k = 0; k < results.size(); ++k) {
+        const auto& r = results[k];
+        out << "    {\"name\": \"" << r.name << "\", \"kind\": \"" << r.kind << "\", \"rows\": " << r.rows
+            << ", \"cols\": " << r.cols << ", \"nnz_A\": " << r.nnz_A << ", \"products\": " << r.products
+            << ", \"nnz_C\": " << r.nnz_C << ", \"compression\": " << compression(r)
+            << ", \"sycl_median_s\": " << r.sycl_median << ", \"sycl_p95_s\": " << r.sycl_p95
+            << ", \"sycl_gflops\": " << gflops(r.products, r.sycl_median)
+            << ", \"mkl_median_s\": " << r.mkl_median << ", \"mkl_p95_s\": " << r.mkl_p95
+            << ", \"mkl_gflops\": " << gflops(r.products, r.mkl_median)
+            << ", \"speedup_vs_mkl\": " << r.mkl_median / r.sycl_median << "}"
+            << (k + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+int main(int argc, char* argv[])
+{
+    int reps = 10, warmup = 2;
+    bool quick = false, gpu = false, triangles = false;
+    size_t batch = 0;
+    bool pipeline = false, reorder = false, bsr = false, chain = false, single_pass = false;
+    std::string csv_file = "bench_results.csv", json_file = "bench_results.json";
+    std::vector<std::string> files;
+
+    for (int k = 1; k < argc; ++k) {
+        std::string arg = argv[k];
+        if (arg == "--reps" && k + 1 < argc) {
+            reps = std::max(1, std::stoi(argv[++k]));
+        } else if (arg == "--warmup" && k + 1 < argc) {
+            warmup = std::max(0, std::stoi(argv[++k]));
+        } else if (arg == "--csv" && k + 1 < argc) {
+            csv_file = argv[++k];
+        } else if (arg == "--json" && k + 1 < argc) {
+            json_file = argv[++k];
+        } else if (arg == "--quick") {
+            quick = true;
+        } else if (arg == "--gpu") {
+            gpu = true;
+        } else if (arg == "--triangles") {
+            triangles = true;
+        } else if (arg == "--pipeline") {
+            pipeline = true;
+        } else if (arg == "--reorder") {
+            reorder = true;
+        } else if (arg == "--single-pass") {
+            single_pass = true;
+        } else if (arg == "--chain") {
+            chain = true;
+        } else if (arg == "--bsr") {
+            bsr = true;
+        } else if (arg == "--batch" && k + 1 < argc) {
+            batch = std::stoul(argv[++k]);
+        } else if (!arg.empty() && arg[0] == '-') {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return 1;
+        } else {
+            files.push_back(arg);
+        }
+    }
+    if (files.empty()) {
+        for (const char* f : {"A2.txt", "A3.txt", "A4.txt", "A5.txt", "A6.txt"}) {
+            if (file_exists(f)) {
+                files.push_back(f);
+            }
+        }
+    }
+
+    try {
+        queue q = gpu ? queue(nvidia_selector, exception_handler) : queue(cpu_selector_v, exception_handler);
+        std::string device = q.get_device().get_info<info::device::name>();
+        std::cout << "Device: " << device << ", warmup " << warmup << ", reps " << reps << std::endl;
+
+        std::vector<BenchCase> cases = make_cases(quick, files);
+        std::vector<BenchResult> results;
+
+        std::cout << std::left << std::setw(28) << "case" << std::right << std::setw(10) << "nnz(A)"
+                  << std::setw(12) << "nnz(C)" << std::setw(8) << "cr" << std::setw(12) << "median s"
+                  << std::setw(12) << "p95 s" << std::setw(10) << "GFLOP/s" << std::setw(12) << "mkl s"
+                  << std::setw(10) << "speedup" << std::endl;
+
+        for (auto& c : cases) {
+            BenchResult r = run_case(c, q, warmup, reps);
+            results.push_back(r);
+            std::cout << std::left << std::setw(28) << r.name << std::right << std::setw(10) << r.nnz_A
+                      << std::setw(12) << r.nnz_C << std::setw(8) << std::setprecision(3) << compression(r)
+                      << std::setw(12) << r.sycl_median << std::setw(12) << r.sycl_p95
+                      << std::setw(10) << gflops(r.products, r.sycl_median) << std::setw(12) << r.mkl_median
+                      << std::setw(10) << r.mkl_median / r.sycl_median << std::endl;
+        }
+
+        if (triangles) {
+            std::cout << std::endl << std::left << std::setw(28) << "triangles" << std::right << std::setw(12)
+                      << "count" << std::setw(12) << "masked s" << std::setw(12) << "dot s" << std::setw(12)
+                      << "gustavson s" << std::setw(12) << "filter s" << std::setw(10) << "speedup" << std::endl;
+            for (auto& c : cases) {
+                run_triangles(c, q, warmup, reps);
+            }
+        }
+
+        if (reorder) {
+            std::cout << std::endl << std::left << std::setw(28) << "reorder" << std::right << std::setw(12)
+                      << "base s" << std::setw(10) << "rcm k" << std::setw(10) << "rcm e2e" << std::setw(10)
+                      << "deg k" << std::setw(10) << "deg e2e" << std::setw(10) << "len k" << std::setw(10)
+                      << "len e2e" << std::endl;
+            for (auto& c : cases) {
+                run_reorder(c, q, warmup, reps);
+            }
+        }
+
+        if (single_pass) {
+            std::cout << std::endl << std::left << std::setw(28) << "single pass" << std::right << std::setw(12)
+                      << "two-pass s" << std::setw(12) << "one-pass s" << std::setw(10) << "speedup" << std::setw(12)
+                      << "2p kernel s" << std::setw(12) << "1p kernel s" << std::setw(10) << "overflow"
+                      << std::setw(8) << "allocs" << std::endl;
+            DeviceArena arena(q);
+            for (auto& c : cases) {
+                run_single_pass(c, q, arena, warmup, reps);
+            }
+        }
+
+        if (chain) {
+            std::cout << std::endl << std::left << std::setw(28) << "chain" << std::right << std::setw(12)
+                      << "A^4 loop s" << std::setw(12) << "power s" << std::setw(10) << "speedup" << std::setw(12)
+                      << "RAR^T loop" << std::setw(12) << "chain s" << std::setw(10) << "speedup" << "  order"
+                      << std::endl;
+            for (auto& c : cases) {
+                run_chain(c, q, warmup, reps);
+            }
+        }
+
+        if (bsr) {
+            std::cout << std::endl << std::left << std::setw(28) << "bsr" << std::right << std::setw(8) << "block"
+                      << std::setw(8) << "fill" << std::setw(12) << "csr mm s" << std::setw(12) << "bsr mm s"
+                      << std::setw(10) << "speedup" << std::setw(12) << "csr mv s" << std::setw(12) << "bsr mv s"
+                      << std::setw(10) << "speedup" << std::endl;
+            run_bsr(quick, q, warmup, reps);
+        }
+
+        if (batch > 0) {
+            run_batch(batch, q, warmup, reps);
+        }
+        if (pipeline) {
+            run_pipeline(files, q, warmup, reps);
+        }
+
+        write_csv(results, csv_file);
+        write_json(results, device, json_file);
+        std::cout << "Results written to " << csv_file << " and " << json_file << std::endl;
+    } catch (std::exception const& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,23 @@
+#include "func.hpp"
+
+// Преобразование текстовых матриц (A*.txt) в двоичный формат CSR для загрузки через mmap
+int main(int argc, char* argv[])
+{
+    if (argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " <input.txt> <output.bin>" << std::endl;
+        return 1;
+    }
+
+    try {
+        auto start = std::chrono::high_resolution_clock::now();
+        convert_text_to_binary(argv[1], argv[2]);
+        auto end = std::chrono::high_resolution_clock::now();
+        std::cout << "Converted " << argv[1] << " -> " << argv[2] << ": "
+                  << std::chrono::duration<double>(end - start).count() << " s" << std::endl;
+    } catch (std::exception const& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
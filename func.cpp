@@ -1,173 +1,4413 @@
 #include "func.hpp"
 
-void sparse_matrix_multiply(const CSRMatrix& A, const CSRMatrix& B1, CSRMatrix& C, queue& q) {
-    if (A.cols != B1.rows) {
+#include <atomic>
+#include <cctype>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <future>
+#include <limits>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <type_traits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Размер аккумулятора строки результата по верхней оценке числа произведений (flops).
+// Для разреженных строк - хеш-таблица размера 2^k >= 2 * flops, для тяжелых строк,
+// у которых такая таблица не меньше числа столбцов, - плотный массив длины cols.
+size_t accumulator_size(size_t flops, size_t cols) {
+    if (flops == 0) {
+        return 0;
+    }
+    size_t size = 1;
+    while (size < 2 * flops) {
+        size <<= 1;
+    }
+    return size >= cols ? cols : size;
+}
+
+// Хеш столбца для таблицы размера 2^k
+template <class Index>
+inline size_t accumulator_hash(Index col, size_t mask) {
+    return (static_cast<size_t>(static_cast<std::make_unsigned_t<Index>>(col)) * 2654435761u) & mask;
+}
+
+// Элемент результата сохраняется, если |v| > eps; порог приводится к типу значений,
+// чтобы ядра для float не выполняли вычислений в double
+template <class Value>
+inline bool is_nonzero(Value v) {
+    return sycl::fabs(v) > static_cast<Value>(eps);
+}
+
+// Ячейка аккумулятора keys[off, off + size) для столбца col (ключ записывается, если его нет).
+// Если size == cols, аккумулятор плотный (ключ - сам номер столбца), иначе это хеш-таблица
+// с линейным пробированием. Пустые ячейки помечены ключом -1.
+template <class KeyAcc, class Index>
+size_t accumulator_slot(const KeyAcc& keys, size_t off, size_t size, Index cols, Index col) {
+    if (size == static_cast<size_t>(cols)) {
+        keys[off + col] = col;
+        return off + col;
+    }
+    size_t mask = size - 1;
+    size_t h = accumulator_hash(col, mask);
+    while (keys[off + h] != -1 && keys[off + h] != col) {
+        h = (h + 1) & mask;
+    }
+    keys[off + h] = col;
+    return off + h;
+}
+
+// Попадает ли ячейка s аккумулятора в C: ключ занят и сумма не равна нулю полукольца.
+// Для полукольца без значений массив сумм не используется.
+template <class Semiring, class Key, class SumAcc>
+inline bool accumulator_keep(Key key, const SumAcc& sums, size_t s) {
+    if constexpr (Semiring::has_values) {
+        return key != -1 && Semiring::keep(sums[s]);
+    } else {
+        return key != -1;
+    }
+}
+
+// Накопление строки row матрицы C = A * B в аккумуляторе keys/sums[off, off + size)
+template <class Semiring = PlusTimes, class IndexAcc, class ValueAcc, class KeyAcc, class SumAcc, class Index>
+void gustavson_accumulate(size_t row, const IndexAcc& a_rp, const IndexAcc& a_ci, const ValueAcc& a_val,
+                          const IndexAcc& b_rp, const IndexAcc& b_ci, const ValueAcc& b_val,
+                          const KeyAcc& keys, const SumAcc& sums, size_t off, size_t size, Index cols) {
+    using Value = std::decay_t<decltype(b_val[0])>;
+    for (size_t s = 0; s < size; ++s) {
+        keys[off + s] = -1;
+        if constexpr (Semiring::has_values) {
+            sums[off + s] = Semiring::template zero<Value>();
+        }
+    }
+
+    for (Index r = a_rp[row]; r < a_rp[row + 1]; ++r) {
+        Index a_col = a_ci[r];
+        for (Index j = b_rp[a_col]; j < b_rp[a_col + 1]; ++j) {
+            size_t slot = accumulator_slot(keys, off, size, cols, b_ci[j]);
+            if constexpr (Semiring::has_values) {
+                Value a = a_val[r];
+                sums[slot] = Semiring::add(sums[slot], Semiring::multiply(a, static_cast<Value>(b_val[j])));
+            }
+        }
+    }
+}
+
+// Пирамидальная сортировка keys[off, off + n) по возрастанию; swap_payload(i, j)
+// переставляет сопутствующие данные вместе с ключами
+template <class KeyAcc, class Swap>
+void heap_sort_by_key(const KeyAcc& keys, size_t off, size_t n, Swap swap_payload) {
+    if (n < 2) {
+        return;
+    }
+
+    auto swap_entries = [&](size_t a, size_t b) {
+        auto k = keys[off + a];
+        keys[off + a] = keys[off + b];
+        keys[off + b] = k;
+        swap_payload(off + a, off + b);
+    };
+
+    auto sift_down = [&](size_t start, size_t end) {
+        size_t root = start;
+        while (2 * root + 1 < end) {
+            size_t child = 2 * root + 1;
+            if (child + 1 < end && keys[off + child] < keys[off + child + 1]) {
+                child++;
+            }
+            if (keys[off + root] >= keys[off + child]) {
+                return;
+            }
+            swap_entries(root, child);
+            root = child;
+        }
+    };
+
+    for (size_t start = n / 2; start-- > 0;) {
+        sift_down(start, n);
+    }
+    for (size_t end = n - 1; end > 0; --end) {
+        swap_entries(0, end);
+        sift_down(0, end);
+    }
+}
+
+// Сжатие аккумулятора: ненулевые элементы (для PlusTimes |sum| > eps) переносятся
+// в начало [off, off + n) в порядке возрастания столбцов. Возвращает n.
+template <class Semiring = PlusTimes, class KeyAcc, class SumAcc, class Index>
+size_t gustavson_compact(const KeyAcc& keys, const SumAcc& sums, size_t off, size_t size, Index cols) {
+    size_t n = 0;
+    for (size_t s = 0; s < size; ++s) {
+        if (accumulator_keep<Semiring>(keys[off + s], sums, off + s)) {
+            keys[off + n] = keys[off + s];
+            if constexpr (Semiring::has_values) {
+                sums[off + n] = sums[off + s];
+            }
+            n++;
+        }
+    }
+
+    // Плотный аккумулятор уже упорядочен по столбцам, хеш-таблицу сортируем
+    if (size != static_cast<size_t>(cols)) {
+        heap_sort_by_key(keys, off, n, [&](size_t a, size_t b) {
+            if constexpr (Semiring::has_values) {
+                auto v = sums[a];
+                sums[a] = sums[b];
+                sums[b] = v;
+            }
+        });
+    }
+    return n;
+}
+
+// Смещения аккумуляторов строк C = A * B в общем рабочем буфере (rows + 1 элементов)
+template <class Index>
+std::vector<size_t> accumulator_offsets(buffer<Index, 1>& buf_row_ptr_A, buffer<Index, 1>& buf_col_ind_A,
+                                        buffer<Index, 1>& buf_row_ptr_B, Index rows, Index cols, queue& q) {
+    // Верхняя оценка числа произведений в каждой строке C
+    std::vector<size_t> row_flops(rows);
+    {
+        buffer<size_t, 1> buf_row_flops(row_flops.data(), range<1>(rows));
+
+        q.submit([&](handler& h) {
+            accessor acc_row_ptr_A = buf_row_ptr_A.template get_access<access::mode::read>(h);
+            accessor acc_col_ind_A = buf_col_ind_A.template get_access<access::mode::read>(h);
+            accessor acc_row_ptr_B = buf_row_ptr_B.template get_access<access::mode::read>(h);
+            accessor acc_row_flops = buf_row_flops.template get_access<access::mode::write>(h);
+
+            h.parallel_for(range<1>(rows), [=](id<1> ind) {
+                size_t i = ind[0];
+                size_t flops = 0;
+                for (Index r = acc_row_ptr_A[i]; r < acc_row_ptr_A[i + 1]; ++r) {
+                    Index col = acc_col_ind_A[r];
+                    flops += acc_row_ptr_B[col + 1] - acc_row_ptr_B[col];
+                }
+                acc_row_flops[i] = flops;
+            });
+        }).wait();
+    }
+
+    std::vector<size_t> offsets(rows + 1, 0);
+    for (Index i = 0; i < rows; ++i) {
+        offsets[i + 1] = offsets[i] + accumulator_size(row_flops[i], cols);
+    }
+    return offsets;
+}
+
+// Включающая префиксная сумма data[0, n) на устройстве: суммы блоков, их последовательная
+// сумма в одном потоке и досчет блоков со смещениями
+template <class T>
+void inclusive_scan_device(buffer<T, 1>& buf_data, size_t n, queue& q) {
+    if (n == 0) {
+        return;
+    }
+
+    size_t blocks = std::min<size_t>(n, 1024);
+    size_t chunk = (n + blocks - 1) / blocks;
+    buffer<T, 1> buf_block_sums{range<1>(blocks)};
+
+    q.submit([&](handler& h) {
+        accessor acc_data = buf_data.template get_access<access::mode::read>(h);
+        accessor acc_block_sums = buf_block_sums.template get_access<access::mode::discard_write>(h);
+
+        h.parallel_for(range<1>(blocks), [=](id<1> ind) {
+            size_t b = ind[0];
+            T sum = 0;
+            for (size_t k = b * chunk; k < sycl::min(n, (b + 1) * chunk); ++k) {
+                sum += acc_data[k];
+            }
+            acc_block_sums[b] = sum;
+        });
+    });
+
+    q.submit([&](handler& h) {
+        accessor acc_block_sums = buf_block_sums.template get_access<access::mode::read_write>(h);
+
+        h.single_task([=]() {
+            T sum = 0;
+            for (size_t b = 0; b < blocks; ++b) {
+                T s = acc_block_sums[b];
+                acc_block_sums[b] = sum;
+                sum += s;
+            }
+        });
+    });
+
+    q.submit([&](handler& h) {
+        accessor acc_data = buf_data.template get_access<access::mode::read_write>(h);
+        accessor acc_block_sums = buf_block_sums.template get_access<access::mode::read>(h);
+
+        h.parallel_for(range<1>(blocks), [=](id<1> ind) {
+            size_t b = ind[0];
+            T sum = acc_block_sums[b];
+            for (size_t k = b * chunk; k < sycl::min(n, (b + 1) * chunk); ++k) {
+                sum += acc_data[k];
+                acc_data[k] = sum;
+            }
+        });
+    });
+}
+
+template <class Index, class Value>
+BasicCSRMatrix<Index, Value> sparse_matrix_transpose(const BasicCSRView<Index, Value>& M, queue& q) {
+    BasicCSRMatrix<Index, Value> T(M.cols, M.rows);
+    T.non_zero_el = static_cast<Index>(M.nnz);
+    T.col_ind.resize(M.nnz);
+    T.values.resize(M.nnz);
+
+    if (M.nnz == 0) {
+        return T;
+    }
+
+    Index ro = M.rows;
+    Index ro_T = M.cols;
+
+    buffer<Index, 1> buf_row_ptr(M.row_ptr, range<1>(M.rows + 1));
+    buffer<Index, 1> buf_col_ind(M.col_ind, range<1>(M.nnz));
+    buffer<Value, 1> buf_values(M.values, range<1>(M.nnz));
+
+    buffer<Index, 1> buf_row_ptr_T(T.row_ptr.data(), range<1>(T.row_ptr.size()));
+    buffer<Index, 1> buf_col_ind_T(T.col_ind.data(), range<1>(M.nnz));
+    buffer<Value, 1> buf_values_T(T.values.data(), range<1>(M.nnz));
+    buffer<Index, 1> buf_cursor{range<1>(ro_T)};
+
+    // Гистограмма столбцов: row_ptr_T[c + 1] - число элементов в столбце c
+    q.submit([&](handler& h) {
+        accessor acc_row_ptr_T = buf_row_ptr_T.template get_access<access::mode::discard_write>(h);
+        h.fill(acc_row_ptr_T, Index(0));
+    });
+
+    q.submit([&](handler& h) {
+        accessor acc_col_ind = buf_col_ind.template get_access<access::mode::read>(h);
+        accessor acc_row_ptr_T = buf_row_ptr_T.template get_access<access::mode::read_write>(h);
+
+        h.parallel_for(range<1>(M.nnz), [=](id<1> ind) {
+            atomic_ref<Index, memory_order::relaxed, memory_scope::device, access::address_space::global_space>
+                count(acc_row_ptr_T[acc_col_ind[ind[0]] + 1]);
+            count.fetch_add(1);
+        });
+    });
+
+    inclusive_scan_device(buf_row_ptr_T, ro_T + 1, q);
+
+    // Раскладка: позиция в строке транспонированной матрицы берется атомарным счетчиком
+    q.submit([&](handler& h) {
+        accessor acc_row_ptr_T = buf_row_ptr_T.template get_access<access::mode::read>(h);
+        accessor acc_cursor = buf_cursor.template get_access<access::mode::discard_write>(h);
+
+        h.parallel_for(range<1>(ro_T), [=](id<1> ind) {
+            acc_cursor[ind] = acc_row_ptr_T[ind[0]];
+        });
+    });
+
+    q.submit([&](handler& h) {
+        accessor acc_row_ptr = buf_row_ptr.template get_access<access::mode::read>(h);
+        accessor acc_col_ind = buf_col_ind.template get_access<access::mode::read>(h);
+        accessor acc_values = buf_values.template get_access<access::mode::read>(h);
+        accessor acc_cursor = buf_cursor.template get_access<access::mode::read_write>(h);
+        accessor acc_col_ind_T = buf_col_ind_T.template get_access<access::mode::write>(h);
+        accessor acc_values_T = buf_values_T.template get_access<access::mode::write>(h);
+
+        h.parallel_for(range<1>(ro), [=](id<1> ind) {
+            Index i = ind[0];
+            for (Index k = acc_row_ptr[i]; k < acc_row_ptr[i + 1]; ++k) {
+                atomic_ref<Index, memory_order::relaxed, memory_scope::device, access::address_space::global_space>
+                    cursor(acc_cursor[acc_col_ind[k]]);
+                Index pos = cursor.fetch_add(1);
+                acc_col_ind_T[pos] = i;
+                acc_values_T[pos] = acc_values[k];
+            }
+        });
+    });
+
+    // Порядок внутри строк после атомарной раскладки произвольный - сортируем
+    q.submit([&](handler& h) {
+        accessor acc_row_ptr_T = buf_row_ptr_T.template get_access<access::mode::read>(h);
+        accessor acc_col_ind_T = buf_col_ind_T.template get_access<access::mode::read_write>(h);
+        accessor acc_values_T = buf_values_T.template get_access<access::mode::read_write>(h);
+
+        h.parallel_for(range<1>(ro_T), [=](id<1> ind) {
+            size_t start = acc_row_ptr_T[ind[0]];
+            size_t n = acc_row_ptr_T[ind[0] + 1] - start;
+            heap_sort_by_key(acc_col_ind_T, start, n, [&](size_t a, size_t b) {
+                Value v = acc_values_T[a];
+                acc_values_T[a] = acc_values_T[b];
+                acc_values_T[b] = v;
+            });
+        });
+    }).wait();
+
+    return T;
+}
+
+// Контрольная сумма FNV-1a по элементам массива: дешевая проверка того, что массив не
+// изменился на месте с тех пор, как по нему построен план умножения или кеш
+template <class T>
+static uint64_t array_checksum(const T* data, size_t n, uint64_t h = 14695981039346656037ull) {
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t bits = 0;
+        std::memcpy(&bits, data + i, sizeof(T));
+        h = (h ^ bits) * 1099511628211ull;
+    }
+    return h;
+}
+
+// Контрольная сумма шаблона разреженности: размеры, row_ptr и col_ind
+template <class Index, class Value>
+static uint64_t pattern_checksum(const BasicCSRView<Index, Value>& M, uint64_t h = 14695981039346656037ull) {
+    int64_t dims[3] = {static_cast<int64_t>(M.rows), static_cast<int64_t>(M.cols), static_cast<int64_t>(M.nnz)};
+    h = array_checksum(dims, 3, h);
+    h = array_checksum(M.row_ptr, static_cast<size_t>(M.rows) + 1, h);
+    return array_checksum(M.col_ind, M.nnz, h);
+}
+
+// Закешированная транспонированная матрица, массивы и версия исходной, по которым она построена
+template <class Index, class Value>
+struct TransposeCache {
+    const Index* row_ptr;
+    const Index* col_ind;
+    const Value* values;
+    size_t row_ptr_size, nnz;
+    Index rows, cols;
+    uint64_t version;
+    BasicCSRMatrix<Index, Value> matrix;
+};
+
+template <class Index, class Value>
+const BasicCSRMatrix<Index, Value>& BasicCSRMatrix<Index, Value>::transposed(queue& q) const {
+    auto valid = [&](const std::shared_ptr<TransposeCache<Index, Value>>& cache) {
+        return cache && cache->row_ptr == row_ptr.data() && cache->col_ind == col_ind.data() &&
+               cache->values == values.data() && cache->row_ptr_size == row_ptr.size() &&
+               cache->nnz == col_ind.size() && cache->rows == rows && cache->cols == cols &&
+               cache->version == version_;
+    };
+    auto cache = std::atomic_load(&transpose_cache);
+    if (valid(cache)) {
+        return cache->matrix;
+    }
+
+    // Кеш не изменяется на месте: его может разделять копия этой матрицы. Если другой поток
+    // успел записать действительный кеш, остается он - выданные ранее ссылки не повисают
+    auto fresh = std::make_shared<TransposeCache<Index, Value>>(TransposeCache<Index, Value>{
+        row_ptr.data(), col_ind.data(), values.data(), row_ptr.size(), col_ind.size(), rows, cols, version_,
+        sparse_matrix_transpose(*this, q)});
+    while (!std::atomic_compare_exchange_strong(&transpose_cache, &cache, fresh)) {
+        if (valid(cache)) {
+            return cache->matrix;
+        }
+    }
+    return fresh->matrix;
+}
+
+template <class Index, class Value>
+BasicSpGEMMPlan<Index, Value>::BasicSpGEMMPlan(const BasicCSRView<Index, Value>& A,
+                                               const BasicCSRView<Index, Value>& B, queue& q)
+    : q(q), C_pattern(A.rows, B.cols), nnz_A(A.nnz), nnz_B(B.nnz),
+      pattern_arrays{A.row_ptr, A.col_ind, B.row_ptr, B.col_ind},
+      checksum(pattern_checksum(B, pattern_checksum(A))),
+      buf_row_ptr_A(A.row_ptr, A.row_ptr + A.rows + 1), buf_col_ind_A(range<1>(std::max<size_t>(nnz_A, 1))),
+      buf_row_ptr_B(B.row_ptr, B.row_ptr + B.rows + 1), buf_col_ind_B(range<1>(std::max<size_t>(nnz_B, 1))),
+      buf_values_A(range<1>(std::max<size_t>(nnz_A, 1))), buf_values_B(range<1>(std::max<size_t>(nnz_B, 1))),
+      buf_acc_offset(range<1>(1)), buf_keys(range<1>(1)), buf_positions(range<1>(1)),
+      buf_row_ptr_C(range<1>(A.rows + 1)), buf_values_C(range<1>(1)) {
+    if (A.cols != B.rows) {
+        throw std::runtime_error("Размеры матриц не совпадают для умножения.");
+    }
+
+    Index ro = A.rows;
+    Index cols = B.cols;
+
+    if (ro == 0 || nnz_A == 0 || nnz_B == 0) {
+        return;
+    }
+
+    buf_col_ind_A = buffer<Index, 1>(A.col_ind, A.col_ind + nnz_A);
+    buf_col_ind_B = buffer<Index, 1>(B.col_ind, B.col_ind + nnz_B);
+
+    std::vector<size_t> acc_offset = accumulator_offsets(buf_row_ptr_A, buf_col_ind_A, buf_row_ptr_B, ro, cols, q);
+    size_t scratch_size = std::max<size_t>(acc_offset[ro], 1);
+
+    buf_acc_offset = buffer<size_t, 1>(acc_offset.begin(), acc_offset.end());
+    buf_keys = buffer<Index, 1>(range<1>(scratch_size));
+    buf_positions = buffer<Index, 1>(range<1>(scratch_size));
+
+    // Символьный этап: число различных столбцов в каждой строке C
+    q.submit([&](handler& h) {
+        accessor acc_row_ptr_A = buf_row_ptr_A.template get_access<access::mode::read>(h);
+        accessor acc_col_ind_A = buf_col_ind_A.template get_access<access::mode::read>(h);
+        accessor acc_row_ptr_B = buf_row_ptr_B.template get_access<access::mode::read>(h);
+        accessor acc_col_ind_B = buf_col_ind_B.template get_access<access::mode::read>(h);
+
+        accessor acc_acc_offset = buf_acc_offset.template get_access<access::mode::read>(h);
+        accessor acc_keys = buf_keys.template get_access<access::mode::read_write>(h);
+        accessor acc_row_ptr_C = buf_row_ptr_C.template get_access<access::mode::write>(h);
+
+        h.parallel_for(range<1>(ro), [=](id<1> ind) {
+            size_t i = ind[0];
+            size_t off = acc_acc_offset[i];
+            size_t size = acc_acc_offset[i + 1] - off;
+
+            for (size_t s = 0; s < size; ++s) {
+                acc_keys[off + s] = -1;
+            }
+            for (Index r = acc_row_ptr_A[i]; r < acc_row_ptr_A[i + 1]; ++r) {
+                Index a_col = acc_col_ind_A[r];
+                for (Index j = acc_row_ptr_B[a_col]; j < acc_row_ptr_B[a_col + 1]; ++j) {
+                    accumulator_slot(acc_keys, off, size, cols, static_cast<Index>(acc_col_ind_B[j]));
+                }
+            }
+
+            Index k = 0;
+            for (size_t s = 0; s < size; ++s) {
+                if (acc_keys[off + s] != -1) {
+                    k++;
+                }
+            }
+            if (i == 0) {
+                acc_row_ptr_C[0] = 0;
+            }
+            acc_row_ptr_C[i + 1] = k;
+        });
+    }).wait();
+
+    {
+        host_accessor acc_row_ptr_C(buf_row_ptr_C);
+        for (Index k = 1; k <= ro; k++) {
+            acc_row_ptr_C[k] += acc_row_ptr_C[k - 1];
+        }
+        for (Index k = 0; k <= ro; k++) {
+            C_pattern.row_ptr[k] = acc_row_ptr_C[k];
+        }
+    }
+
+    C_pattern.non_zero_el = C_pattern.row_ptr[ro];
+    C_pattern.col_ind.resize(C_pattern.non_zero_el);
+    C_pattern.values.assign(C_pattern.non_zero_el, 0);
+    buf_values_C = buffer<Value, 1>(range<1>(std::max<size_t>(C_pattern.non_zero_el, 1)));
+
+    // Упорядоченные столбцы C и позиции элементов C в аккумуляторах
+    {
+        buffer<Index, 1> buf_col_ind_C(C_pattern.col_ind.data(), range<1>(C_pattern.non_zero_el));
+
+        q.submit([&](handler& h) {
+            accessor acc_acc_offset = buf_acc_offset.template get_access<access::mode::read>(h);
+            accessor acc_keys = buf_keys.template get_access<access::mode::read_write>(h);
+            accessor acc_positions = buf_positions.template get_access<access::mode::write>(h);
+            accessor acc_row_ptr_C = buf_row_ptr_C.template get_access<access::mode::read>(h);
+            accessor acc_col_ind_C = buf_col_ind_C.template get_access<access::mode::write>(h);
+
+            h.parallel_for(range<1>(ro), [=](id<1> ind) {
+                size_t i = ind[0];
+                size_t off = acc_acc_offset[i];
+                size_t size = acc_acc_offset[i + 1] - off;
+                size_t start = acc_row_ptr_C[i];
+
+                size_t n = 0;
+                for (size_t s = 0; s < size; ++s) {
+                    if (acc_keys[off + s] != -1) {
+                        acc_col_ind_C[start + n] = acc_keys[off + s];
+                        n++;
+                    }
+                }
+                if (size != static_cast<size_t>(cols)) {
+                    heap_sort_by_key(acc_col_ind_C, start, n, [](size_t, size_t) {});
+                }
+                for (size_t k = 0; k < n; ++k) {
+                    acc_positions[accumulator_slot(acc_keys, off, size, cols, static_cast<Index>(acc_col_ind_C[start + k]))] = start + k;
+                }
+            });
+        }).wait();
+    }
+}
+
+template <class Index, class Value>
+void BasicSpGEMMPlan<Index, Value>::execute(const BasicCSRView<Index, Value>& A, const BasicCSRView<Index, Value>& B,
+                                            BasicCSRMatrix<Index, Value>& C) {
+    if (A.nnz != nnz_A || B.nnz != nnz_B ||
+        A.rows != C_pattern.rows || B.cols != C_pattern.cols) {
+        throw std::runtime_error("Шаблон матриц не совпадает с шаблоном плана умножения.");
+    }
+
+    // Шаблон сверяется по контрольной сумме, если массивы не те, по которым построен план;
+    // в отладочной сборке - при каждом вызове, чтобы найти и изменения на месте
+    bool verify = A.row_ptr != pattern_arrays[0] || A.col_ind != pattern_arrays[1] ||
+                  B.row_ptr != pattern_arrays[2] || B.col_ind != pattern_arrays[3];
+#if _DEBUG
+    verify = true;
+#endif
+    if (verify && pattern_checksum(B, pattern_checksum(A)) != checksum) {
+        throw std::runtime_error("Шаблон матриц не совпадает с шаблоном плана умножения.");
+    }
+
+    // Шаблон результата копируется, если C не получила его в прошлом вызове: после него
+    // версию C меняет только invalidate_transposed(), а перевыделение меняет адреса массивов
+    bool has_pattern = C.version() == result_version && result_version != 0 &&
+                       C.row_ptr.data() == result_arrays[0] && C.col_ind.data() == result_arrays[1] &&
+                       C.row_ptr.size() == C_pattern.row_ptr.size() && C.col_ind.size() == C_pattern.col_ind.size();
+    C.rows = C_pattern.rows;
+    C.cols = C_pattern.cols;
+    C.non_zero_el = C_pattern.non_zero_el;
+    if (!has_pattern) {
+        C.row_ptr = C_pattern.row_ptr;
+        C.col_ind = C_pattern.col_ind;
+    }
+    C.values.resize(C_pattern.non_zero_el);
+    C.invalidate_transposed();
+    result_arrays[0] = C.row_ptr.data();
+    result_arrays[1] = C.col_ind.data();
+    result_version = C.version();
+
+    if (C_pattern.non_zero_el == 0) {
+        return;
+    }
+
+    Index ro = C_pattern.rows;
+    Index cols = C_pattern.cols;
+
+    q.submit([&](handler& h) {
+        accessor acc_values_A = buf_values_A.template get_access<access::mode::discard_write>(h);
+        h.copy(A.values, acc_values_A);
+    });
+    q.submit([&](handler& h) {
+        accessor acc_values_B = buf_values_B.template get_access<access::mode::discard_write>(h);
+        h.copy(B.values, acc_values_B);
+    });
+
+    // Численный этап: сложение произведений сразу в позиции элементов C
+    q.submit([&](handler& h) {
+        accessor acc_row_ptr_A = buf_row_ptr_A.template get_access<access::mode::read>(h);
+        accessor acc_col_ind_A = buf_col_ind_A.template get_access<access::mode::read>(h);
+        accessor acc_values_A = buf_values_A.template get_access<access::mode::read>(h);
+
+        accessor acc_row_ptr_B = buf_row_ptr_B.template get_access<access::mode::read>(h);
+        accessor acc_col_ind_B = buf_col_ind_B.template get_access<access::mode::read>(h);
+        accessor acc_values_B = buf_values_B.template get_access<access::mode::read>(h);
+
+        accessor acc_acc_offset = buf_acc_offset.template get_access<access::mode::read>(h);
+        accessor acc_keys = buf_keys.template get_access<access::mode::read_write>(h);
+        accessor acc_positions = buf_positions.template get_access<access::mode::read>(h);
+
+        accessor acc_row_ptr_C = buf_row_ptr_C.template get_access<access::mode::read>(h);
+        accessor acc_values_C = buf_values_C.template get_access<access::mode::discard_write>(h);
+
+        h.parallel_for(range<1>(ro), [=](id<1> ind) {
+            size_t i = ind[0];
+            size_t off = acc_acc_offset[i];
+            size_t size = acc_acc_offset[i + 1] - off;
+
+            for (Index p = acc_row_ptr_C[i]; p < acc_row_ptr_C[i + 1]; ++p) {
+                acc_values_C[p] = 0;
+            }
+            for (Index r = acc_row_ptr_A[i]; r < acc_row_ptr_A[i + 1]; ++r) {
+                Index a_col = acc_col_ind_A[r];
+                Value a = acc_values_A[r];
+                for (Index j = acc_row_ptr_B[a_col]; j < acc_row_ptr_B[a_col + 1]; ++j) {
+                    size_t slot = accumulator_slot(acc_keys, off, size, cols, static_cast<Index>(acc_col_ind_B[j]));
+                    acc_values_C[acc_positions[slot]] += a * acc_values_B[j];
+                }
+            }
+        });
+    });
+
+    q.submit([&](handler& h) {
+        accessor acc_values_C = buf_values_C.template get_access<access::mode::read>(h);
+        h.copy(acc_values_C, C.values.data());
+    }).wait();
+}
+
+CSRMatrix csr_matrix_multiply(const CSRMatrix& A, const CSRMatrix& B, CSRMatrix& C, queue& q) {
+    SpGEMMPlan plan(A, B, q);
+    plan.execute(A, B, C);
+    return C;
+}
+
+// Размер рабочей группы сканирования exclusive_scan_device
+static size_t scan_work_group_size(queue& q) {
+    return std::min<size_t>(256, q.get_device().get_info<info::device::max_work_group_size>());
+}
+
+// Число элементов временного буфера exclusive_scan_device для n элементов: итоги групп
+// всех уровней рекурсии
+static size_t scan_temp_size(size_t n, queue& q) {
+    size_t wg = scan_work_group_size(q);
+    size_t total = 0;
+    while (n > 0) {
+        size_t groups = (n + wg - 1) / wg;
+        total += groups;
+        n = groups > 1 ? groups : 0;
+    }
+    return total;
+}
+
+// Исключающая префиксная сумма data[0, n) в памяти устройства: сканирование внутри
+// рабочих групп, рекурсивная сумма итогов групп и добавление смещений. Итоги групп
+// хранятся в temp (scan_temp_size(n, q) элементов, память вызывающего). Ядра связаны
+// событиями и не ожидаются: вызывающий ждет возвращенное событие или события в events.
+template <class T>
+event exclusive_scan_device(T* data, size_t n, T* temp, queue& q, std::vector<event>* events = nullptr,
+                            const std::vector<event>& depends = {}) {
+    if (n == 0) {
+        return event();
+    }
+
+    size_t wg = scan_work_group_size(q);
+    size_t groups = (n + wg - 1) / wg;
+    T* block_sums = temp;
+
+    event scan = q.submit([&](handler& h) {
+        h.depends_on(depends);
+        h.parallel_for(nd_range<1>(range<1>(groups * wg), range<1>(wg)), [=](nd_item<1> it) {
+            size_t i = it.get_global_id(0);
+            T x = i < n ? data[i] : T(0);
+            T prefix = exclusive_scan_over_group(it.get_group(), x, sycl::plus<T>());
+            if (i < n) {
+                data[i] = prefix;
+            }
+            if (it.get_local_id(0) == wg - 1) {
+                block_sums[it.get_group(0)] = prefix + x;
+            }
+        });
+    });
+    if (events != nullptr) {
+        events->push_back(scan);
+    }
+    if (groups == 1) {
+        return scan;
+    }
+
+    event sums = exclusive_scan_device(block_sums, groups, temp + groups, q, events, {scan});
+    event add = q.submit([&](handler& h) {
+        h.depends_on(sums);
+        h.parallel_for(range<1>(n), [=](id<1> ind) {
+            data[ind] += block_sums[ind[0] / wg];
+        });
+    });
+    if (events != nullptr) {
+        events->push_back(add);
+    }
+    return add;
+}
+
+template <class Index, class Value>
+BasicDeviceCSRMatrix<Index, Value>::BasicDeviceCSRMatrix(queue& q)
+    : rows(0), cols(0), nnz(0), row_ptr(nullptr), col_ind(nullptr), values(nullptr), q(q) {
+    allocate(0, 0, 0);
+}
+
+template <class Index, class Value>
+BasicDeviceCSRMatrix<Index, Value>::BasicDeviceCSRMatrix(const BasicCSRView<Index, Value>& M, queue& q)
+    : rows(0), cols(0), nnz(0), row_ptr(nullptr), col_ind(nullptr), values(nullptr), q(q) {
+    allocate(M.rows, M.cols, M.nnz);
+    q.memcpy(row_ptr, M.row_ptr, (M.rows + 1) * sizeof(Index));
+    if (M.nnz > 0) {
+        q.memcpy(col_ind, M.col_ind, M.nnz * sizeof(Index));
+        q.memcpy(values, M.values, M.nnz * sizeof(Value));
+    }
+    q.wait();
+}
+
+template <class Index, class Value>
+BasicDeviceCSRMatrix<Index, Value>::~BasicDeviceCSRMatrix() {
+    release();
+}
+
+template <class Index, class Value>
+BasicDeviceCSRMatrix<Index, Value>::BasicDeviceCSRMatrix(BasicDeviceCSRMatrix&& other) noexcept
+    : rows(other.rows), cols(other.cols), nnz(other.nnz),
+      row_ptr(other.row_ptr), col_ind(other.col_ind), values(other.values), q(other.q),
+      row_capacity_(other.row_capacity_), nnz_capacity_(other.nnz_capacity_) {
+    other.row_ptr = nullptr;
+    other.col_ind = nullptr;
+    other.values = nullptr;
+    other.rows = other.cols = 0;
+    other.nnz = 0;
+    other.row_capacity_ = other.nnz_capacity_ = 0;
+}
+
+template <class Index, class Value>
+BasicDeviceCSRMatrix<Index, Value>& BasicDeviceCSRMatrix<Index, Value>::operator=(BasicDeviceCSRMatrix&& other) noexcept {
+    if (this != &other) {
+        release();
+        rows = other.rows;
+        cols = other.cols;
+        nnz = other.nnz;
+        row_ptr = other.row_ptr;
+        col_ind = other.col_ind;
+        values = other.values;
+        q = other.q;
+        row_capacity_ = other.row_capacity_;
+        nnz_capacity_ = other.nnz_capacity_;
+        other.row_ptr = nullptr;
+        other.col_ind = nullptr;
+        other.values = nullptr;
+        other.rows = other.cols = 0;
+        other.nnz = 0;
+        other.row_capacity_ = other.nnz_capacity_ = 0;
+    }
+    return *this;
+}
+
+template <class Index, class Value>
+void BasicDeviceCSRMatrix<Index, Value>::release() {
+    if (row_ptr != nullptr) {
+        sycl::free(row_ptr, q);
+    }
+    if (col_ind != nullptr) {
+        sycl::free(col_ind, q);
+    }
+    if (values != nullptr) {
+        sycl::free(values, q);
+    }
+    row_ptr = nullptr;
+    col_ind = nullptr;
+    values = nullptr;
+    row_capacity_ = 0;
+    nnz_capacity_ = 0;
+}
+
+template <class Index, class Value>
+void BasicDeviceCSRMatrix<Index, Value>::reserve(Index r, size_t n) {
+    // При росте буфер выделяется с запасом в половину прежней емкости, как в SpGEMMScratch
+    size_t need_rows = static_cast<size_t>(r);
+    if (row_ptr == nullptr || need_rows > row_capacity_) {
+        size_t capacity = std::max(need_rows, row_capacity_ + row_capacity_ / 2);
+        if (row_ptr != nullptr) {
+            sycl::free(row_ptr, q);
+        }
+        row_ptr = malloc_device<Index>(capacity + 1, q);
+        row_capacity_ = capacity;
+    }
+    if (col_ind == nullptr || values == nullptr || n > nnz_capacity_) {
+        size_t capacity = std::max({n, nnz_capacity_ + nnz_capacity_ / 2, size_t(1)});
+        if (col_ind != nullptr) {
+            sycl::free(col_ind, q);
+        }
+        if (values != nullptr) {
+            sycl::free(values, q);
+        }
+        col_ind = malloc_device<Index>(capacity, q);
+        values = malloc_device<Value>(capacity, q);
+        nnz_capacity_ = capacity;
+    }
+    if (row_ptr == nullptr || col_ind == nullptr || values == nullptr) {
+        release();
+        rows = cols = 0;
+        nnz = 0;
+        throw std::runtime_error("Не удалось выделить память на устройстве.");
+    }
+}
+
+template <class Index, class Value>
+void BasicDeviceCSRMatrix<Index, Value>::allocate(Index r, Index c, size_t n) {
+    reserve(r, n);
+    rows = r;
+    cols = c;
+    nnz = n;
+    q.fill(row_ptr, Index(0), rows + 1).wait();
+}
+
+template <class Index, class Value>
+void BasicDeviceCSRMatrix<Index, Value>::allocate_rows(Index r, Index c) {
+    reserve(r, 0);
+    rows = r;
+    cols = c;
+    nnz = 0;
+}
+
+template <class Index, class Value>
+void BasicDeviceCSRMatrix<Index, Value>::allocate_nnz(size_t n) {
+    reserve(rows, n);
+    nnz = n;
+}
+
+template <class Index, class Value>
+BasicCSRMatrix<Index, Value> BasicDeviceCSRMatrix<Index, Value>::to_host() const {
+    BasicCSRMatrix<Index, Value> M(rows, cols);
+    M.non_zero_el = static_cast<Index>(nnz);
+    M.col_ind.resize(nnz);
+    M.values.resize(nnz);
+    q.memcpy(M.row_ptr.data(), row_ptr, (rows + 1) * sizeof(Index));
+    if (nnz > 0) {
+        q.memcpy(M.col_ind.data(), col_ind, nnz * sizeof(Index));
+        q.memcpy(M.values.data(), values, nnz * sizeof(Value));
+    }
+    q.wait();
+    return M;
+}
+
+// Атомарная ссылка на элемент аккумулятора, общего для нескольких рабочих элементов
+template <class T>
+using shared_atomic = atomic_ref<T, memory_order::relaxed, memory_scope::device, access::address_space::generic_space>;
+
+// Ячейка общего аккумулятора keys[0, size) для столбца col: то же, что accumulator_slot,
+// но ключ вставляется атомарно, так как строку накапливают несколько рабочих элементов
+template <class Index>
+inline size_t accumulator_slot_atomic(Index* keys, size_t size, Index cols, Index col) {
+    if (size == static_cast<size_t>(cols)) {
+        shared_atomic<Index>(keys[col]).store(col);
+        return col;
+    }
+    size_t mask = size - 1;
+    size_t h = accumulator_hash(col, mask);
+    while (true) {
+        shared_atomic<Index> key(keys[h]);
+        Index current = key.load();
+        if (current == col) {
+            return h;
+        }
+        if (current == -1) {
+            Index expected = -1;
+            if (key.compare_exchange_strong(expected, col) || expected == col) {
+                return h;
+            }
+        }
+        h = (h + 1) & mask;
+    }
+}
+
+// Накопление строки row группой рабочих элементов (подгруппой или рабочей группой):
+// элементы строки A распределяются по lanes, произведения складываются атомарно
+template <class Semiring, class Group, class Index, class Value>
+void group_accumulate_row(Group g, size_t lane, size_t lanes, size_t row,
+                          const Index* a_rp, const Index* a_ci, const Value* a_val,
+                          const Index* b_rp, const Index* b_ci, const Value* b_val,
+                          Index* keys, Value* sums, size_t size, Index cols) {
+    for (size_t s = lane; s < size; s += lanes) {
+        keys[s] = -1;
+        if constexpr (Semiring::has_values) {
+            sums[s] = Semiring::template zero<Value>();
+        }
+    }
+    group_barrier(g);
+
+    for (Index r = a_rp[row] + static_cast<Index>(lane); r < a_rp[row + 1]; r += static_cast<Index>(lanes)) {
+        Index a_col = a_ci[r];
+        for (Index j = b_rp[a_col]; j < b_rp[a_col + 1]; ++j) {
+            size_t slot = accumulator_slot_atomic(keys, size, cols, b_ci[j]);
+            if constexpr (Semiring::has_values) {
+                Semiring::atomic_add(shared_atomic<Value>(sums[slot]), Semiring::multiply(a_val[r], b_val[j]));
+            }
+        }
+    }
+    group_barrier(g);
+}
+
+// Сжатие строки, накопленной группой, в начало аккумулятора в порядке возрастания столбцов.
+// Хеш-таблица после сжатия сортируется битонной сортировкой (ее размер - степень двойки).
+// Возвращает число элементов строки.
+template <class Semiring, class Group, class Index, class Value>
+size_t group_compact_row(Group g, size_t lane, size_t lanes, Index* keys, Value* sums, size_t size, Index cols) {
+    // Сжатие в начало аккумулятора с сохранением порядка ячеек
+    size_t n = 0;
+    for (size_t base = 0; base < size; base += lanes) {
+        size_t s = base + lane;
+        Index key = -1;
+        Value v = 0;
+        int keep = 0;
+        if (s < size) {
+            key = keys[s];
+            keep = accumulator_keep<Semiring>(key, sums, s);
+            if constexpr (Semiring::has_values) {
+                v = sums[s];
+            }
+        }
+        int pos = exclusive_scan_over_group(g, keep, sycl::plus<int>());
+        int total = reduce_over_group(g, keep, sycl::plus<int>());
+        if (keep) {
+            keys[n + pos] = key;
+            if constexpr (Semiring::has_values) {
+                sums[n + pos] = v;
+            }
+        }
+        n += total;
+    }
+    group_barrier(g);
+
+    if (size != static_cast<size_t>(cols)) {
+        size_t padded = 1;
+        while (padded < n) {
+            padded <<= 1;
+        }
+        for (size_t s = n + lane; s < padded; s += lanes) {
+            keys[s] = std::numeric_limits<Index>::max();
+        }
+        group_barrier(g);
+
+        for (size_t k = 2; k <= padded; k <<= 1) {
+            for (size_t j = k >> 1; j > 0; j >>= 1) {
+                for (size_t t = lane; t < padded; t += lanes) {
+                    size_t partner = t ^ j;
+                    if (partner > t && ((keys[t] > keys[partner]) == ((t & k) == 0))) {
+                        Index key = keys[t];
+                        keys[t] = keys[partner];
+                        keys[partner] = key;
+                        if constexpr (Semiring::has_values) {
+                            Value v = sums[t];
+                            sums[t] = sums[partner];
+                            sums[partner] = v;
+                        }
+                    }
+                }
+                group_barrier(g);
+            }
+        }
+    }
+    return n;
+}
+
+// Завершение строки, накопленной группой: на символьном этапе (fill == false) в c_rp[row]
+// записывается число ненулевых элементов, на численном - упорядоченная строка C
+template <class Semiring, class Group, class Index, class Value>
+void group_finish_row(Group g, size_t lane, size_t lanes, size_t row, Index* keys, Value* sums,
+                      size_t size, Index cols, bool fill, Index* c_rp, Index* c_ci, Value* c_val) {
+    if (!fill) {
+        Index k = 0;
+        for (size_t s = lane; s < size; s += lanes) {
+            if (accumulator_keep<Semiring>(keys[s], sums, s)) {
+                k++;
+            }
+        }
+        k = reduce_over_group(g, k, sycl::plus<Index>());
+        if (lane == 0) {
+            c_rp[row] = k;
+        }
+        return;
+    }
+
+    size_t n = group_compact_row<Semiring>(g, lane, lanes, keys, sums, size, cols);
+    Index start = c_rp[row];
+    for (size_t e = lane; e < n; e += lanes) {
+        c_ci[start + e] = keys[e];
+        if constexpr (Semiring::has_values) {
+            c_val[start + e] = sums[e];
+        }
+    }
+    group_barrier(g);
+}
+
+// Число ячеек локального аккумулятора рабочей группы (степень двойки) с ячейками
+// по slot_bytes байт, занимающего не больше половины локальной памяти устройства
+size_t local_accumulator_capacity(const device& dev, size_t slot_bytes) {
+    size_t local_mem = dev.get_info<info::device::local_mem_size>();
+    size_t capacity = 1;
+    while (2 * capacity * slot_bytes <= local_mem / 2) {
+        capacity <<= 1;
+    }
+    return capacity;
+}
+
+// Время этапа умножения: по событиям SYCL (от начала первой команды до конца последней),
+// если очередь создана с профилированием, иначе по часам хоста от создания таймера
+class PhaseTimer {
+public:
+    explicit PhaseTimer(queue& q)
+        : profiling(q.has_property<property::queue::enable_profiling>()),
+          start(std::chrono::steady_clock::now()) {}
+
+    event record(event e) {
+        events.push_back(e);
+        return e;
+    }
+
+    std::vector<event>* sink() {
+        return &events;
+    }
+
+    // Ожидание команд этапа и его длительность в секундах
+    double finish() {
+        for (auto& e : events) {
+            e.wait();
+        }
+        if (profiling && !events.empty()) {
+            uint64_t first = std::numeric_limits<uint64_t>::max();
+            uint64_t last = 0;
+            for (auto& e : events) {
+                first = std::min(first, e.get_profiling_info<info::event_profiling::command_start>());
+                last = std::max(last, e.get_profiling_info<info::event_profiling::command_end>());
+            }
+            return (last - first) * 1e-9;
+        }
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+private:
+    bool profiling;
+    std::chrono::steady_clock::time_point start;
+    std::vector<event> events;
+};
+
+std::string MultiplyStats::to_json() const {
+    std::ostringstream out;
+    out << std::setprecision(9);
+    out << "{\"upload\":" << upload << ",\"binning\":" << binning << ",\"scan\":" << scan
+        << ",\"symbolic\":" << symbolic << ",\"numeric\":" << numeric << ",\"transfer\":" << transfer
+        << ",\"download\":" << download << ",\"load\":" << load << ",\"reorder\":" << reorder
+        << ",\"write\":" << write << ",\"total\":" << total
+        << ",\"bytes_to_device\":" << bytes_to_device << ",\"bytes_from_device\":" << bytes_from_device
+        << ",\"products\":" << products << ",\"gflops\":" << gflops() << ",\"nnz_C\":" << nnz_C
+        << ",\"peak_scratch_bytes\":" << peak_scratch_bytes << ",\"panels\":" << panels
+        << ",\"overflow_rows\":" << overflow_rows
+        << ",\"device_timing\":" << (device_timing ? "true" : "false") << ",\"bins\":[";
+    for (int b = 0; b < 3; ++b) {
+        out << (b ? "," : "") << "{\"rows\":" << bins.rows[b] << ",\"flops\":" << bins.flops[b]
+            << ",\"max_flops\":" << bins.max_flops[b] << "}";
+    }
+    out << "]}";
+    return out.str();
+}
+
+void MultiplyStats::print() const {
+    std::cout << std::fixed << std::setprecision(6);
+    std::cout << "Время этапов (" << (device_timing ? "события SYCL" : "часы хоста") << "), с:" << std::endl;
+    std::cout << "  загрузка A, B: " << upload << std::endl;
+    std::cout << "  разбиение строк: " << binning << std::endl;
+    std::cout << "  префиксные суммы: " << scan << std::endl;
+    std::cout << "  символьный этап: " << symbolic << std::endl;
+    std::cout << "  численный этап: " << numeric << std::endl;
+    std::cout << "  чтение счетчиков: " << transfer << std::endl;
+    std::cout << "  выгрузка C: " << download << std::endl;
+    if (load > 0) {
+        std::cout << "  ожидание загрузки входных матриц: " << load << std::endl;
+    }
+    if (reorder > 0) {
+        std::cout << "  переупорядочивание: " << reorder << std::endl;
+    }
+    if (write > 0) {
+        std::cout << "  запись C в файл: " << write << std::endl;
+    }
+    std::cout << "  всего: " << total << std::endl;
+    std::cout << "Байт на устройство: " << bytes_to_device << ", с устройства: " << bytes_from_device << std::endl;
+    std::cout << "Произведений: " << products << ", GFLOP/s: " << gflops() << ", nnz(C): " << nnz_C << std::endl;
+    std::cout << "Пик рабочей памяти, байт: " << peak_scratch_bytes << std::endl;
+    if (panels > 1) {
+        std::cout << "Панелей строк A: " << panels << std::endl;
+    }
+    if (overflow_rows > 0) {
+        std::cout << "Строк сверх оценки длины: " << overflow_rows << std::endl;
+    }
+    std::cout.unsetf(std::ios::floatfield);
+    bins.print();
+}
+
+// Запись статистики строкой JSON в файл из SPGEMM_STATS_JSON ("-" - в stdout)
+static void dump_stats_json(const MultiplyStats& stats) {
+    const char* path = std::getenv("SPGEMM_STATS_JSON");
+    if (path == nullptr || *path == '\0') {
+        return;
+    }
+    if (std::strcmp(path, "-") == 0) {
+        std::cout << stats.to_json() << std::endl;
+        return;
+    }
+    std::ofstream out(path, std::ios::app);
+    if (!out.is_open()) {
+        throw std::runtime_error("Не удалось открыть файл статистики: " + std::string(path));
+    }
+    out << stats.to_json() << '\n';
+}
+
+void SpGEMMBinStats::print() const {
+    const char* names[3] = {"tiny (work-item)", "medium (sub-group)", "heavy (work-group)"};
+    for (int b = 0; b < 3; ++b) {
+        std::cout << names[b] << ": rows " << rows[b] << ", flops " << flops[b]
+                  << ", max row flops " << max_flops[b] << std::endl;
+    }
+}
+
+// Разбиение строк C = A * B на корзины по верхней оценке числа произведений. Каждая
+// корзина - отдельный список строк bin_rows[b * ro, (b + 1) * ro); счетчики (обнуляются
+// заранее): bin_info[b] - число строк, bin_info[3 + b] - сумма flops, bin_info[6 + b] -
+// максимум. acc_offset[i] - размер аккумулятора строки до префиксной суммы. Для каждой
+// строки в ядре вызывается row_hook(i, flops); в acc_offset[ro] и row_hook(ro, 0)
+// записывается ноль для префиксной суммы.
+template <class Index, class RowHook>
+static event bin_rows_by_flops(const Index* a_rp, const Index* a_ci, const Index* b_rp, Index ro, Index cols,
+                               const SpGEMMBinning& binning, size_t* acc_offset, Index* bin_rows, size_t* bin_info,
+                               size_t wg, queue& q, RowHook row_hook) {
+    size_t tiny_max = binning.tiny_max;
+    size_t medium_max = std::max(binning.medium_max, binning.tiny_max);
+    size_t bin_groups = (ro + 1 + wg - 1) / wg;
+    return q.submit([&](handler& h) {
+        h.parallel_for(nd_range<1>(range<1>(bin_groups * wg), range<1>(wg)), [=](nd_item<1> it) {
+            size_t i = it.get_global_id(0);
+            auto g = it.get_group();
+
+            size_t flops = 0;
+            if (i < static_cast<size_t>(ro)) {
+                for (Index r = a_rp[i]; r < a_rp[i + 1]; ++r) {
+                    Index col = a_ci[r];
+                    flops += b_rp[col + 1] - b_rp[col];
+                }
+                acc_offset[i] = accumulator_size(flops, cols);
+                row_hook(i, flops);
+            } else if (i == static_cast<size_t>(ro)) {
+                acc_offset[i] = 0;
+                row_hook(i, 0);
+            }
+            int bin = flops <= tiny_max ? 0 : (flops <= medium_max ? 1 : 2);
+
+            for (int b = 0; b < 3; ++b) {
+                int member = i < static_cast<size_t>(ro) && bin == b;
+                size_t member_flops = member ? flops : 0;
+                int pos = exclusive_scan_over_group(g, member, sycl::plus<int>());
+                int total = reduce_over_group(g, member, sycl::plus<int>());
+                size_t group_flops = reduce_over_group(g, member_flops, sycl::plus<size_t>());
+                size_t group_max = reduce_over_group(g, member_flops, sycl::maximum<size_t>());
+
+                size_t base = 0;
+                if (it.get_local_id(0) == 0 && total > 0) {
+                    base = shared_atomic<size_t>(bin_info[b]).fetch_add(total);
+                    shared_atomic<size_t>(bin_info[3 + b]).fetch_add(group_flops);
+                    shared_atomic<size_t>(bin_info[6 + b]).fetch_max(group_max);
+                }
+                base = group_broadcast(g, base, 0);
+                if (member) {
+                    bin_rows[b * static_cast<size_t>(ro) + base + pos] = static_cast<Index>(i);
+                }
+            }
+        });
+    });
+}
+
+// Рабочая память multiply_on_device: раскладка корзин и аккумуляторы строк. Буферы растут
+// по требованию и сохраняются между умножениями, поэтому последовательность умножений
+// (цепочка, степень матрицы) выделяет память на устройстве только при росте буферов.
+template <class Index, class Value>
+class SpGEMMScratch {
+public:
+    explicit SpGEMMScratch(queue& q) : q(q) {}
+
+    ~SpGEMMScratch() {
+        release(acc_offset_);
+        release(bin_rows_);
+        release(bin_info_);
+        release(keys_);
+        release(sums_);
+        release(scan_temp_);
+    }
+
+    SpGEMMScratch(const SpGEMMScratch&) = delete;
+    SpGEMMScratch& operator=(const SpGEMMScratch&) = delete;
+
+    size_t* acc_offset(size_t n) { return reserve(acc_offset_, acc_offset_capacity, n); }
+    Index* bin_rows(size_t n) { return reserve(bin_rows_, bin_rows_capacity, n); }
+    size_t* bin_info(size_t n) { return reserve(bin_info_, bin_info_capacity, n); }
+    Index* keys(size_t n) { return reserve(keys_, keys_capacity, n); }
+    Value* sums(size_t n) { return reserve(sums_, sums_capacity, n); }
+    // Итоги групп exclusive_scan_device для n элементов типа T
+    template <class T>
+    T* scan_temp(size_t n) {
+        return reinterpret_cast<T*>(reserve(scan_temp_, scan_temp_capacity, scan_temp_size(n, q) * sizeof(T)));
+    }
+
+private:
+    queue q;
+    size_t* acc_offset_ = nullptr;
+    Index* bin_rows_ = nullptr;
+    size_t* bin_info_ = nullptr;
+    Index* keys_ = nullptr;
+    Value* sums_ = nullptr;
+    unsigned char* scan_temp_ = nullptr;
+    size_t acc_offset_capacity = 0, bin_rows_capacity = 0, bin_info_capacity = 0;
+    size_t keys_capacity = 0, sums_capacity = 0, scan_temp_capacity = 0;
+
+    // Буфер не меньше n элементов; при росте выделяется с запасом в половину размера
+    template <class T>
+    T* reserve(T*& ptr, size_t& capacity, size_t n) {
+        if (n > capacity) {
+            release(ptr);
+            capacity = std::max(n, capacity + capacity / 2);
+            ptr = malloc_device<T>(capacity, q);
+            if (ptr == nullptr) {
+                capacity = 0;
+                throw std::runtime_error("Не удалось выделить память на устройстве.");
+            }
+        }
+        return ptr;
+    }
+
+    template <class T>
+    void release(T*& ptr) {
+        if (ptr != nullptr) {
+            sycl::free(ptr, q);
+            ptr = nullptr;
+        }
+    }
+};
+
+// Умножение матриц в памяти устройства над полукольцом Semiring; времена этапов, счетчики
+// и объемы копирований добавляются в stats. Для полукольца без значений массивы сумм
+// не выделяются, а values сомножителей и C не читаются и не записываются. Рабочие буферы
+// берутся из scratch, если он задан, иначе выделяются на время умножения.
+template <class Semiring = PlusTimes, class Index, class Value>
+static void multiply_on_device(const BasicDeviceCSRMatrix<Index, Value>& A, const BasicDeviceCSRMatrix<Index, Value>& B,
+                               BasicDeviceCSRMatrix<Index, Value>& C, queue& q,
+                               const SpGEMMBinning& binning, MultiplyStats& stats,
+                               SpGEMMScratch<Index, Value>* scratch = nullptr) {
+    if (A.cols != B.rows) {
+        throw std::runtime_error("Размеры матриц не совпадают для умножения.");
+    }
+    if (&C == &A || &C == &B) {
+        throw std::runtime_error("Результат умножения не может совпадать с сомножителем.");
+    }
+
+    Index ro = A.rows;
+    Index cols = B.cols;
+
+    const Index* a_rp = A.row_ptr;
+    const Index* a_ci = A.col_ind;
+    const Value* a_val = A.values;
+    const Index* b_rp = B.row_ptr;
+    const Index* b_ci = B.col_ind;
+    const Value* b_val = B.values;
+
+    stats.device_timing = q.has_property<property::queue::enable_profiling>();
+    if (ro == 0 || A.nnz == 0 || B.nnz == 0) {
+        C.allocate(ro, cols, 0);
+        return;
+    }
+
+    size_t max_wg = q.get_device().get_info<info::device::max_work_group_size>();
+    size_t wg = std::min<size_t>(256, max_wg);
+
+    // Разбиение строк по верхней оценке числа произведений и раскладка аккумуляторов
+    SpGEMMScratch<Index, Value> local_scratch(q);
+    SpGEMMScratch<Index, Value>& work = scratch != nullptr ? *scratch : local_scratch;
+    size_t* acc_offset = work.acc_offset(ro + 1);
+    Index* bin_rows = work.bin_rows(3 * static_cast<size_t>(ro));
+    size_t* bin_info = work.bin_info(9);
+
+    PhaseTimer binning_timer(q);
+    binning_timer.record(q.fill(bin_info, size_t(0), 9)).wait();
+
+    binning_timer.record(bin_rows_by_flops(a_rp, a_ci, b_rp, ro, cols, binning, acc_offset, bin_rows, bin_info, wg, q,
+                                           [](size_t, size_t) {}));
+    stats.binning += binning_timer.finish();
+
+    size_t info[9];
+    PhaseTimer transfer_timer(q);
+    transfer_timer.record(q.memcpy(info, bin_info, sizeof(info)));
+    stats.transfer += transfer_timer.finish();
+    stats.bytes_from_device += sizeof(info);
+    for (int b = 0; b < 3; ++b) {
+        stats.bins.rows[b] += info[b];
+        stats.bins.flops[b] += info[3 + b];
+        stats.bins.max_flops[b] = std::max<size_t>(stats.bins.max_flops[b], info[6 + b]);
+        stats.products += info[3 + b];
+    }
+
+    PhaseTimer scan_timer(q);
+    exclusive_scan_device(acc_offset, ro + 1, work.template scan_temp<size_t>(ro + 1), q, scan_timer.sink());
+    stats.scan += scan_timer.finish();
+
+    size_t scratch_size = 0;
+    transfer_timer = PhaseTimer(q);
+    transfer_timer.record(q.memcpy(&scratch_size, acc_offset + ro, sizeof(size_t)));
+    stats.transfer += transfer_timer.finish();
+    stats.bytes_from_device += sizeof(size_t);
+    scratch_size = std::max<size_t>(scratch_size, 1);
+    size_t sum_bytes = Semiring::has_values ? sizeof(Value) : 0;
+    stats.peak_scratch_bytes = std::max(stats.peak_scratch_bytes,
+                                        (ro + 1) * sizeof(size_t) + 3 * static_cast<size_t>(ro) * sizeof(Index) +
+                                        scratch_size * (sizeof(Index) + sum_bytes));
+
+    Index* keys = work.keys(scratch_size);
+    Value* sums = Semiring::has_values ? work.sums(scratch_size) : nullptr;
+    C.allocate_rows(ro, cols);
+    Index* c_rp = C.row_ptr;
+    Index* c_ci = nullptr;
+    Value* c_val = nullptr;
+
+    size_t n_tiny = info[0];
+    size_t n_medium = info[1];
+    size_t n_heavy = info[2];
+    const Index* tiny_rows = bin_rows;
+    const Index* medium_rows = bin_rows + ro;
+    const Index* heavy_rows = bin_rows + 2 * static_cast<size_t>(ro);
+    size_t local_capacity = local_accumulator_capacity(q.get_device(), sizeof(Index) + sum_bytes);
+
+    // Запуск трех вариантов ядра. На символьном этапе (fill == false) строки накапливаются
+    // в аккумуляторах рабочего буфера и подсчитываются, на численном - те же аккумуляторы
+    // сжимаются и записываются в C без повторного накопления. Поэтому решение |sum| > eps
+    // на обоих этапах принимается по одним и тем же суммам, хотя порядок атомарных
+    // сложений в строках, накапливаемых группой, не фиксирован.
+    auto run_bins = [&](bool fill, PhaseTimer& timer) {
+        // Короткие строки: строка на рабочий элемент, аккумулятор в глобальной памяти
+        if (n_tiny > 0) {
+            timer.record(q.submit([&](handler& h) {
+                h.parallel_for(range<1>(n_tiny), [=](id<1> ind) {
+                    size_t i = tiny_rows[ind[0]];
+                    size_t off = acc_offset[i];
+                    size_t size = acc_offset[i + 1] - off;
+
+                    if (!fill) {
+                        gustavson_accumulate<Semiring>(i, a_rp, a_ci, a_val, b_rp, b_ci, b_val, keys, sums, off,
+                                                       size, cols);
+
+                        Index k = 0;
+                        for (size_t s = 0; s < size; ++s) {
+                            if (accumulator_keep<Semiring>(keys[off + s], sums, off + s)) {
+                                k++;
+                            }
+                        }
+                        c_rp[i] = k;
+                        return;
+                    }
+
+                    size_t n = gustavson_compact<Semiring>(keys, sums, off, size, cols);
+                    Index start = c_rp[i];
+                    for (size_t k = 0; k < n; ++k) {
+                        c_ci[start + k] = keys[off + k];
+                        if constexpr (Semiring::has_values) {
+                            c_val[start + k] = sums[off + k];
+                        }
+                    }
+                });
+            }));
+        }
+
+        // Средние строки: строка на подгруппу, аккумулятор в глобальной памяти
+        if (n_medium > 0) {
+            size_t groups = std::min<size_t>((n_medium * 16 + wg - 1) / wg, 65536);
+            timer.record(q.submit([&](handler& h) {
+                h.parallel_for(nd_range<1>(range<1>(groups * wg), range<1>(wg)), [=](nd_item<1> it) {
+                    auto sg = it.get_sub_group();
+                    size_t lane = sg.get_local_linear_id();
+                    size_t lanes = sg.get_local_linear_range();
+                    size_t per_group = sg.get_group_range()[0];
+                    size_t first = it.get_group(0) * per_group + sg.get_group_linear_id();
+                    size_t stride = it.get_group_range(0) * per_group;
+
+                    for (size_t r = first; r < n_medium; r += stride) {
+                        size_t i = medium_rows[r];
+                        size_t off = acc_offset[i];
+                        size_t size = acc_offset[i + 1] - off;
+                        Value* row_sums = Semiring::has_values ? sums + off : nullptr;
+                        if (!fill) {
+                            group_accumulate_row<Semiring>(sg, lane, lanes, i, a_rp, a_ci, a_val, b_rp, b_ci,
+                                                           b_val, keys + off, row_sums, size, cols);
+                        }
+                        group_finish_row<Semiring>(sg, lane, lanes, i, keys + off, row_sums, size, cols,
+                                                   fill, c_rp, c_ci, c_val);
+                    }
+                });
+            }));
+        }
+
+        // Тяжелые строки: строка на рабочую группу, аккумулятор в локальной памяти,
+        // если помещается, иначе в глобальной
+        if (n_heavy > 0) {
+            timer.record(q.submit([&](handler& h) {
+                local_accessor<Index, 1> local_keys(range<1>(local_capacity), h);
+                local_accessor<Value, 1> local_sums(range<1>(Semiring::has_values ? local_capacity : 1), h);
+
+                h.parallel_for(nd_range<1>(range<1>(n_heavy * wg), range<1>(wg)), [=](nd_item<1> it) {
+                    auto g = it.get_group();
+                    size_t lane = it.get_local_id(0);
+                    size_t i = heavy_rows[it.get_group(0)];
+                    size_t off = acc_offset[i];
+                    size_t size = acc_offset[i + 1] - off;
+
+                    bool in_local = size <= local_capacity;
+                    Index* row_keys = in_local ? &local_keys[0] : keys + off;
+                    Value* row_sums = !Semiring::has_values ? nullptr : (in_local ? &local_sums[0] : sums + off);
+
+                    // Аккумулятор из локальной памяти сохраняется в глобальный буфер между этапами
+                    if (!fill) {
+                        group_accumulate_row<Semiring>(g, lane, wg, i, a_rp, a_ci, a_val, b_rp, b_ci, b_val,
+                                                       row_keys, row_sums, size, cols);
+                    } else if (in_local) {
+                        for (size_t s = lane; s < size; s += wg) {
+                            row_keys[s] = keys[off + s];
+                            if constexpr (Semiring::has_values) {
+                                row_sums[s] = sums[off + s];
+                            }
+                        }
+                        group_barrier(g);
+                    }
+
+                    group_finish_row<Semiring>(g, lane, wg, i, row_keys, row_sums, size, cols, fill, c_rp, c_ci, c_val);
+
+                    if (!fill && in_local) {
+                        for (size_t s = lane; s < size; s += wg) {
+                            keys[off + s] = row_keys[s];
+                            if constexpr (Semiring::has_values) {
+                                sums[off + s] = row_sums[s];
+                            }
+                        }
+                    }
+                });
+            }));
+        }
+    };
+
+    // Символьный этап: число ненулевых элементов в каждой строке C
+    PhaseTimer symbolic_timer(q);
+    symbolic_timer.record(q.fill(c_rp, Index(0), ro + 1)).wait();
+    run_bins(false, symbolic_timer);
+    stats.symbolic += symbolic_timer.finish();
+
+    scan_timer = PhaseTimer(q);
+    exclusive_scan_device(c_rp, ro + 1, work.template scan_temp<Index>(ro + 1), q, scan_timer.sink());
+    stats.scan += scan_timer.finish();
+
+    Index nnz_C = 0;
+    transfer_timer = PhaseTimer(q);
+    transfer_timer.record(q.memcpy(&nnz_C, c_rp + ro, sizeof(Index)));
+    stats.transfer += transfer_timer.finish();
+    stats.bytes_from_device += sizeof(Index);
+    stats.nnz_C += nnz_C;
+
+    C.allocate_nnz(nnz_C);
+    c_ci = C.col_ind;
+    c_val = C.values;
+
+    // Численный этап: запись упорядоченных строк C из аккумуляторов
+    if (nnz_C > 0) {
+        PhaseTimer numeric_timer(q);
+        run_bins(true, numeric_timer);
+        stats.numeric += numeric_timer.finish();
+    }
+}
+
+template <class Semiring, class Index, class Value>
+MultiplyStats sparse_matrix_multiply(const BasicDeviceCSRMatrix<Index, Value>& A,
+                                     const BasicDeviceCSRMatrix<Index, Value>& B,
+                                     BasicDeviceCSRMatrix<Index, Value>& C,
+                                     queue& q, const SpGEMMBinning& binning) {
+    auto start = std::chrono::steady_clock::now();
+    MultiplyStats stats;
+    multiply_on_device<Semiring>(A, B, C, q, binning, stats);
+    // C на устройстве остается полной матрицей: значения полукольца без значений равны 1
+    if (!Semiring::has_values && C.nnz > 0) {
+        q.fill(C.values, Value(1), C.nnz).wait();
+    }
+    stats.total = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    dump_stats_json(stats);
+    return stats;
+}
+
+// Верхняя оценка числа произведений строки i матрицы A * B
+template <class Index, class Value>
+static size_t row_flops(const BasicCSRView<Index, Value>& A, const BasicCSRView<Index, Value>& B, Index i) {
+    size_t flops = 0;
+    for (Index r = A.row_ptr[i]; r < A.row_ptr[i + 1]; ++r) {
+        Index col = A.col_ind[r];
+        flops += B.row_ptr[col + 1] - B.row_ptr[col];
+    }
+    return flops;
+}
+
+// Строки [r0, r1) матрицы A как отдельная матрица; row_ptr панели отсчитывается от нуля
+// и хранится в rp, col_ind и values указывают в массивы A
+template <class Index, class Value>
+static BasicCSRView<Index, Value> row_panel(const BasicCSRView<Index, Value>& A, Index r0, Index r1,
+                                            std::vector<Index>& rp) {
+    Index base = A.row_ptr[r0];
+    rp.resize(r1 - r0 + 1);
+    for (Index i = r0; i <= r1; ++i) {
+        rp[i - r0] = A.row_ptr[i] - base;
+    }
+    return BasicCSRView<Index, Value>(r1 - r0, A.cols, rp[r1 - r0], rp.data(), A.col_ind + base, A.values + base);
+}
+
+// Копирование матрицы M в D (память выделяется заранее) с учетом событий копирования.
+// Без values (with_values == false) копируется только структура.
+template <class Index, class Value>
+static size_t upload_matrix(const BasicCSRView<Index, Value>& M, BasicDeviceCSRMatrix<Index, Value>& D, queue& q,
+                            PhaseTimer& timer, bool with_values = true, const std::vector<event>& depends = {}) {
+    D.allocate(M.rows, M.cols, M.nnz);
+    size_t value_bytes = with_values ? sizeof(Value) : 0;
+    timer.record(q.memcpy(D.row_ptr, M.row_ptr, (M.rows + 1) * sizeof(Index), depends));
+    if (M.nnz > 0) {
+        timer.record(q.memcpy(D.col_ind, M.col_ind, M.nnz * sizeof(Index), depends));
+        if (with_values) {
+            timer.record(q.memcpy(D.values, M.values, M.nnz * sizeof(Value), depends));
+        }
+    }
+    return (M.rows + 1) * sizeof(Index) + M.nnz * (sizeof(Index) + value_bytes);
+}
+
+// Копирование матрицы D с устройства в M; время и объем добавляются в stats.
+// Без values (with_values == false) значения M равны 1.
+template <class Index, class Value>
+static void download_matrix(const BasicDeviceCSRMatrix<Index, Value>& D, BasicCSRMatrix<Index, Value>& M, queue& q,
+                            MultiplyStats& stats, bool with_values = true) {
+    PhaseTimer timer(q);
+    BasicCSRMatrix<Index, Value> result(D.rows, D.cols);
+    size_t value_bytes = with_values ? sizeof(Value) : 0;
+    result.non_zero_el = static_cast<Index>(D.nnz);
+    result.col_ind.resize(D.nnz);
+    result.values.resize(D.nnz, Value(1));
+    timer.record(q.memcpy(result.row_ptr.data(), D.row_ptr, (D.rows + 1) * sizeof(Index)));
+    if (D.nnz > 0) {
+        timer.record(q.memcpy(result.col_ind.data(), D.col_ind, D.nnz * sizeof(Index)));
+        if (with_values) {
+            timer.record(q.memcpy(result.values.data(), D.values, D.nnz * sizeof(Value)));
+        }
+    }
+    stats.download += timer.finish();
+    stats.bytes_from_device += (D.rows + 1) * sizeof(Index) + D.nnz * (sizeof(Index) + value_bytes);
+    M = std::move(result);
+}
+
+template <class Semiring, class Index, class Value>
+MultiplyStats sparse_matrix_multiply(const non_deduced_t<BasicCSRView<Index, Value>>& A,
+                                     const non_deduced_t<BasicCSRView<Index, Value>>& B,
+                                     BasicCSRMatrix<Index, Value>& C, queue& q, const SpGEMMBinning& binning,
+                                     const std::vector<event>& depends) {
+    if (A.cols != B.rows) {
+        throw std::runtime_error("Размеры матриц не совпадают для умножения.");
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    MultiplyStats stats;
+
+    BasicDeviceCSRMatrix<Index, Value> A_dev(q);
+    BasicDeviceCSRMatrix<Index, Value> B_dev(q);
+    BasicDeviceCSRMatrix<Index, Value> C_dev(q);
+    PhaseTimer upload_timer(q);
+    stats.bytes_to_device += upload_matrix(A, A_dev, q, upload_timer, Semiring::has_values, depends);
+    stats.bytes_to_device += upload_matrix(B, B_dev, q, upload_timer, Semiring::has_values, depends);
+    stats.upload = upload_timer.finish();
+
+    multiply_on_device<Semiring>(A_dev, B_dev, C_dev, q, binning, stats);
+
+    download_matrix(C_dev, C, q, stats, Semiring::has_values);
+
+    stats.total = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    dump_stats_json(stats);
+    return stats;
+}
+
+// Функция для чтения матрицы в формате CSR из файла
+template <class Index, class Value>
+BasicCSRMatrix<Index, Value> read_matrix_from_file(const std::string& filename) {
+    BasicCSRMatrix<Index, Value> matrix;
+    Index non_zero_elements;
+    std::ifstream file(filename);
+
+    if (!file.is_open()) {
+        throw std::runtime_error("Не удалось открыть файл: " + filename);
+    }
+
+    // Считываем количество строк и столбцов
+    file >> matrix.rows >> non_zero_elements;
+    matrix.cols = matrix.rows;
+    matrix.non_zero_el = non_zero_elements;
+
+    // Считываем массив row_ptr
+    matrix.row_ptr.resize(matrix.rows + 1);
+    for (Index i = 0; i <= matrix.rows; ++i) {
+        file >> matrix.row_ptr[i];
+    }
+    if (!file || matrix.row_ptr[matrix.rows] != non_zero_elements) {
+        throw std::runtime_error("Заголовок не согласован с row_ptr в файле: " + filename);
+    }
+
+    // Считываем массив col_ind
+    matrix.col_ind.resize(non_zero_elements);
+    for (Index i = 0; i < non_zero_elements; ++i) {
+        file >> matrix.col_ind[i];
+    }
+
+    // Считываем массив values
+    matrix.values.resize(non_zero_elements);
+    for (Index i = 0; i < non_zero_elements; ++i) {
+        file >> matrix.values[i];
+    }
+
+    file.close();
+    return matrix;
+}
+
+// Смещение, выровненное вверх на alignment (степень двойки)
+static uint64_t align_up(uint64_t offset, uint64_t alignment) {
+    return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+// Заголовок двоичного CSR-файла: смещения массивов для заданных размеров и выравнивания
+template <class Index, class Value>
+static CSRBinaryHeader make_binary_header(int64_t rows, int64_t cols, int64_t nnz, uint32_t alignment) {
+    if (alignment < alignof(uint64_t) || (alignment & (alignment - 1)) != 0) {
+        throw std::runtime_error("Выравнивание должно быть степенью двойки не меньше " + std::to_string(alignof(uint64_t)));
+    }
+
+    CSRBinaryHeader header = {};
+    std::strncpy(header.magic, CSR_BINARY_MAGIC, sizeof(header.magic));
+    header.version = CSR_BINARY_VERSION;
+    header.index_width = sizeof(Index);
+    header.value_width = sizeof(Value);
+    header.alignment = alignment;
+    header.rows = rows;
+    header.cols = cols;
+    header.nnz = nnz;
+    header.row_ptr_offset = align_up(sizeof(CSRBinaryHeader), alignment);
+    header.col_ind_offset = align_up(header.row_ptr_offset + (rows + 1) * sizeof(Index), alignment);
+    header.values_offset = align_up(header.col_ind_offset + nnz * sizeof(Index), alignment);
+    return header;
+}
+
+// Дополнение файла нулями до смещения offset (начала следующего массива)
+static void pad_to(std::ostream& file, uint64_t offset) {
+    static const char zeros[4096] = {};
+    uint64_t pos = static_cast<uint64_t>(file.tellp());
+    while (pos < offset) {
+        uint64_t n = std::min<uint64_t>(offset - pos, sizeof(zeros));
+        file.write(zeros, n);
+        pos += n;
+    }
+}
+
+template <class Index, class Value>
+void write_matrix_binary(const BasicCSRView<Index, Value>& matrix, const std::string& filename, uint32_t alignment) {
+    CSRBinaryHeader header = make_binary_header<Index, Value>(matrix.rows, matrix.cols, matrix.nnz, alignment);
+
+    std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        throw std::runtime_error("Не удалось открыть файл: " + filename);
+    }
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    pad_to(file, header.row_ptr_offset);
+    file.write(reinterpret_cast<const char*>(matrix.row_ptr), (matrix.rows + 1) * sizeof(Index));
+    pad_to(file, header.col_ind_offset);
+    file.write(reinterpret_cast<const char*>(matrix.col_ind), matrix.nnz * sizeof(Index));
+    pad_to(file, header.values_offset);
+    file.write(reinterpret_cast<const char*>(matrix.values), matrix.nnz * sizeof(Value));
+
+    if (!file) {
+        throw std::runtime_error("Ошибка записи файла: " + filename);
+    }
+}
+
+void convert_text_to_binary(const std::string& text_filename, const std::string& binary_filename) {
+    CSRMatrix matrix = read_matrix_from_file(text_filename);
+    write_matrix_binary(matrix, binary_filename);
+}
+
+// Оценка памяти устройства для строки A при умножении на B: строка A, аккумулятор,
+// раскладка корзин и строка C по верхней оценке nnz = flops
+template <class Index, class Value>
+static size_t panel_row_bytes(const BasicCSRView<Index, Value>& A, const BasicCSRView<Index, Value>& B, Index i) {
+    size_t flops = row_flops(A, B, i);
+    size_t entry = sizeof(Index) + sizeof(Value);
+    size_t a_nnz = A.row_ptr[i + 1] - A.row_ptr[i];
+    return sizeof(size_t) + 5 * sizeof(Index) + (a_nnz + accumulator_size(flops, B.cols) + flops) * entry;
+}
+
+// Удаление файла результата при выходе из области видимости, если запись не была
+// завершена (прервана исключением)
+struct FileCleanup {
+    std::string output;
+    bool committed = false;
+
+    ~FileCleanup() {
+        if (!committed && !output.empty()) {
+            std::remove(output.c_str());
+        }
+    }
+};
+
+template <class Index, class Value>
+MultiplyStats sparse_matrix_multiply_to_file(const BasicCSRView<Index, Value>& A, const BasicCSRView<Index, Value>& B,
+                                             const std::string& filename, size_t memory_budget, queue& q,
+                                             const SpGEMMBinning& binning, uint32_t alignment) {
+    if (A.cols != B.rows) {
+        throw std::runtime_error("Размеры матриц не совпадают для умножения.");
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    MultiplyStats stats;
+    stats.panels = 0;
+
+    size_t b_bytes = (B.rows + 1) * sizeof(Index) + B.nnz * (sizeof(Index) + sizeof(Value));
+    if (memory_budget <= b_bytes) {
+        throw std::runtime_error("Бюджет памяти меньше размера матрицы B: " + std::to_string(b_bytes) + " байт.");
+    }
+    size_t panel_budget = memory_budget - b_bytes;
+
+    // Границы панелей: строки добавляются, пока оценка памяти панели не превысит бюджет.
+    // Заодно считается верхняя оценка nnz(C): в строке не больше min(flops, B.cols) элементов
+    std::vector<Index> bounds = {0};
+    size_t panel_bytes = 0;
+    size_t max_nnz_C = 0;
+    for (Index i = 0; i < A.rows; ++i) {
+        size_t row_bytes = panel_row_bytes(A, B, i);
+        max_nnz_C += std::min<size_t>(row_flops(A, B, i), B.cols);
+        if (panel_bytes > 0 && panel_bytes + row_bytes > panel_budget) {
+            bounds.push_back(i);
+            panel_bytes = 0;
+        }
+        panel_bytes += row_bytes;
+    }
+    if (bounds.back() != A.rows || A.rows == 0) {
+        bounds.push_back(A.rows);
+    }
+
+    // Секция значений начинается после места под col_ind по верхней оценке nnz(C): значения
+    // каждой панели пишутся сразу на свое место, а в заголовок попадает фактическое nnz(C)
+    // и это смещение. Неиспользованный хвост секции col_ind остается дырой в файле.
+    CSRBinaryHeader header = make_binary_header<Index, Value>(A.rows, B.cols, max_nnz_C, alignment);
+    uint64_t col_ind_offset = header.col_ind_offset;
+    uint64_t values_offset = header.values_offset;
+    FileCleanup cleanup;
+    std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        throw std::runtime_error("Не удалось открыть файл: " + filename);
+    }
+    cleanup.output = filename;
+
+    BasicDeviceCSRMatrix<Index, Value> B_dev(q);
+    PhaseTimer upload_timer(q);
+    stats.bytes_to_device += upload_matrix(B, B_dev, q, upload_timer);
+    stats.upload += upload_timer.finish();
+
+    std::vector<Index> row_ptr(A.rows + 1, 0);
+    size_t nnz_C = 0;
+    std::future<double> writer;
+
+    for (size_t p = 0; p + 1 < bounds.size(); ++p) {
+        Index r0 = bounds[p];
+        Index r1 = bounds[p + 1];
+        std::vector<Index> panel_rp;
+        BasicCSRView<Index, Value> panel = row_panel(A, r0, r1, panel_rp);
+
+        BasicDeviceCSRMatrix<Index, Value> A_dev(q);
+        BasicDeviceCSRMatrix<Index, Value> C_dev(q);
+        upload_timer = PhaseTimer(q);
+        stats.bytes_to_device += upload_matrix(panel, A_dev, q, upload_timer);
+        stats.upload += upload_timer.finish();
+
+        multiply_on_device(A_dev, B_dev, C_dev, q, binning, stats);
+
+        auto C_panel = std::make_shared<BasicCSRMatrix<Index, Value>>();
+        download_matrix(C_dev, *C_panel, q, stats);
+        ++stats.panels;
+
+        if (nnz_C + C_dev.nnz > static_cast<size_t>(std::numeric_limits<Index>::max())) {
+            throw std::runtime_error("nnz(C) не помещается в тип индекса.");
+        }
+        for (Index i = 1; i <= r1 - r0; ++i) {
+            row_ptr[r0 + i] = static_cast<Index>(nnz_C) + C_panel->row_ptr[i];
+        }
+        nnz_C += C_dev.nnz;
+
+        // Запись предыдущей панели должна завершиться до запуска следующей: потоки
+        // файлов пишутся последовательно
+        if (writer.valid()) {
+            stats.write += writer.get();
+        }
+        // Смещения панели в секциях col_ind и values известны до записи
+        uint64_t col_ind_pos = col_ind_offset + (nnz_C - C_dev.nnz) * sizeof(Index);
+        uint64_t values_pos = values_offset + (nnz_C - C_dev.nnz) * sizeof(Value);
+        writer = std::async(std::launch::async, [&file, &filename, C_panel, col_ind_pos, values_pos]() {
+            auto write_start = std::chrono::steady_clock::now();
+            file.seekp(col_ind_pos);
+            file.write(reinterpret_cast<const char*>(C_panel->col_ind.data()), C_panel->col_ind.size() * sizeof(Index));
+            file.seekp(values_pos);
+            file.write(reinterpret_cast<const char*>(C_panel->values.data()), C_panel->values.size() * sizeof(Value));
+            if (!file) {
+                throw std::runtime_error("Ошибка записи в файл: " + filename);
+            }
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - write_start).count();
+        });
+    }
+    if (writer.valid()) {
+        stats.write += writer.get();
+    }
+
+    // Заголовок с итоговым nnz(C) и смещением значений, затем row_ptr. Если C пуста, файл
+    // дополняется до начала секции значений, иначе он уже заканчивается значениями
+    auto finish_start = std::chrono::steady_clock::now();
+    header = make_binary_header<Index, Value>(A.rows, B.cols, nnz_C, alignment);
+    header.values_offset = values_offset;
+    file.seekp(0, std::ios::end);
+    pad_to(file, values_offset + nnz_C * sizeof(Value));
+    file.seekp(0);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    pad_to(file, header.row_ptr_offset);
+    file.write(reinterpret_cast<const char*>(row_ptr.data()), row_ptr.size() * sizeof(Index));
+    file.close();
+    if (!file) {
+        throw std::runtime_error("Ошибка записи в файл: " + filename);
+    }
+    cleanup.committed = true;
+    stats.write += std::chrono::duration<double>(std::chrono::steady_clock::now() - finish_start).count();
+
+    stats.nnz_C = nnz_C;
+    stats.total = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    dump_stats_json(stats);
+    return stats;
+}
+
+MappedCSRMatrix::MappedCSRMatrix(const std::string& filename) : data(nullptr), size(0) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Не удалось открыть файл: " + filename);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(CSRBinaryHeader)) {
+        close(fd);
+        throw std::runtime_error("Файл не является двоичной CSR-матрицей: " + filename);
+    }
+    size = st.st_size;
+
+    // Страницы подгружаются при первом обращении, поэтому открытие не зависит от размера файла
+    data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        data = nullptr;
+        throw std::runtime_error("Не удалось отобразить файл в память: " + filename);
+    }
+
+    const CSRBinaryHeader& h = header();
+    std::string error;
+    if (std::strncmp(h.magic, CSR_BINARY_MAGIC, sizeof(h.magic)) != 0) {
+        error = "Файл не является двоичной CSR-матрицей: ";
+    } else if (h.version != CSR_BINARY_VERSION) {
+        error = "Неподдерживаемая версия двоичного CSR-файла: ";
+    } else if ((h.index_width != 4 && h.index_width != 8) || (h.value_width != 4 && h.value_width != 8)) {
+        error = "Неподдерживаемые размеры индексов или значений в файле: ";
+    } else if (h.rows < 0 || h.cols < 0 || h.nnz < 0 ||
+               h.row_ptr_offset % h.index_width != 0 || h.col_ind_offset % h.index_width != 0 ||
+               h.values_offset % h.value_width != 0 ||
+               h.row_ptr_offset + (h.rows + 1) * h.index_width > size ||
+               h.col_ind_offset + h.nnz * h.index_width > size ||
+               h.values_offset + h.nnz * h.value_width > size) {
+        error = "Поврежденный заголовок двоичного CSR-файла: ";
+    }
+
+    if (!error.empty()) {
+        munmap(data, size);
+        data = nullptr;
+        throw std::runtime_error(error + filename);
+    }
+}
+
+MappedCSRMatrix::~MappedCSRMatrix() {
+    if (data != nullptr) {
+        munmap(data, size);
+    }
+}
+
+MappedCSRMatrix::MappedCSRMatrix(MappedCSRMatrix&& other) noexcept : data(other.data), size(other.size) {
+    other.data = nullptr;
+    other.size = 0;
+}
+
+MappedCSRMatrix& MappedCSRMatrix::operator=(MappedCSRMatrix&& other) noexcept {
+    if (this != &other) {
+        if (data != nullptr) {
+            munmap(data, size);
+        }
+        data = other.data;
+        size = other.size;
+        other.data = nullptr;
+        other.size = 0;
+    }
+    return *this;
+}
+
+template <class Index, class Value>
+BasicCSRView<Index, Value> MappedCSRMatrix::view() const {
+    const CSRBinaryHeader& h = header();
+    if (h.index_width != sizeof(Index) || h.value_width != sizeof(Value)) {
+        throw std::runtime_error("Типы индексов или значений не совпадают с двоичным CSR-файлом (индексы " +
+                                 std::to_string(h.index_width) + " байт, значения " +
+                                 std::to_string(h.value_width) + " байт)");
+    }
+    if (h.rows > std::numeric_limits<Index>::max() || h.cols > std::numeric_limits<Index>::max() ||
+        h.nnz > std::numeric_limits<Index>::max()) {
+        throw std::runtime_error("Размеры матрицы из двоичного CSR-файла не помещаются в тип индексов");
+    }
+    const char* base = static_cast<const char*>(data);
+    return BasicCSRView<Index, Value>(static_cast<Index>(h.rows), static_cast<Index>(h.cols),
+                                      static_cast<size_t>(h.nnz),
+                                      reinterpret_cast<const Index*>(base + h.row_ptr_offset),
+                                      reinterpret_cast<const Index*>(base + h.col_ind_offset),
+                                      reinterpret_cast<const Value*>(base + h.values_offset));
+}
+
+template <class Index, class Value>
+BasicCSRMatrix<Index, Value> MappedCSRMatrix::to_matrix() const {
+    BasicCSRView<Index, Value> v = view<Index, Value>();
+    return BasicCSRMatrix<Index, Value>(v.rows, v.cols,
+                                        std::vector<Index>(v.row_ptr, v.row_ptr + v.rows + 1),
+                                        std::vector<Index>(v.col_ind, v.col_ind + v.nnz),
+                                        std::vector<Value>(v.values, v.values + v.nnz),
+                                        static_cast<Index>(v.nnz));
+}
+
+// Запуск f(t) для t = 0..num_threads-1 в отдельных потоках; первое исключение пробрасывается
+template <class F>
+static void run_threads(unsigned num_threads, F f) {
+    std::vector<std::thread> threads;
+    std::vector<std::exception_ptr> errors(num_threads);
+    for (unsigned t = 0; t < num_threads; ++t) {
+        threads.emplace_back([&, t] {
+            try {
+                f(t);
+            } catch (...) {
+                errors[t] = std::current_exception();
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (auto& e : errors) {
+        if (e) {
+            std::rethrow_exception(e);
+        }
+    }
+}
+
+// Элемент строки при сборке CSR из координатного формата
+template <class Index, class Value>
+struct MatrixMarketEntry {
+    Index col;
+    Value value;
+};
+
+template <class Index, class Value>
+BasicCSRMatrix<Index, Value> read_matrix_market(const std::string& filename, unsigned num_threads) {
+    if (num_threads == 0) {
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Не удалось открыть файл: " + filename);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        throw std::runtime_error("Не удалось открыть файл: " + filename);
+    }
+    size_t size = st.st_size;
+    void* data = size > 0 ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (data == MAP_FAILED) {
+        throw std::runtime_error("Не удалось отобразить файл в память: " + filename);
+    }
+    madvise(data, size, MADV_SEQUENTIAL);
+
+    // Файл освобождается при любом выходе из функции
+    std::unique_ptr<void, std::function<void(void*)>> mapping(data, [size](void* p) { munmap(p, size); });
+
+    const char* begin = static_cast<const char*>(data);
+    const char* end = begin + size;
+    const char* p = begin;
+
+    auto next_line = [&](const char* s) {
+        const char* nl = static_cast<const char*>(std::memchr(s, '\n', end - s));
+        return nl != nullptr ? nl + 1 : end;
+    };
+    auto format_error = [&](const std::string& what) {
+        return std::runtime_error("Ошибка формата Matrix Market (" + what + "): " + filename);
+    };
+
+    // Заголовок: %%MatrixMarket matrix coordinate <field> <symmetry>
+    std::string banner(p, next_line(p));
+    std::transform(banner.begin(), banner.end(), banner.begin(), [](unsigned char c) { return std::tolower(c); });
+    std::istringstream banner_stream(banner);
+    std::string tag, object, format, field, symmetry;
+    banner_stream >> tag >> object >> format >> field >> symmetry;
+    if (tag != "%%matrixmarket" || object != "matrix") {
+        throw format_error("заголовок");
+    }
+    if (format != "coordinate") {
+        throw format_error("поддерживается только coordinate");
+    }
+    bool pattern = field == "pattern";
+    if (!pattern && field != "real" && field != "double" && field != "integer") {
+        throw format_error("неподдерживаемый тип значений " + field);
+    }
+    bool symmetric = symmetry == "symmetric" || symmetry == "hermitian";
+    bool skew = symmetry == "skew-symmetric";
+    if (!symmetric && !skew && symmetry != "general") {
+        throw format_error("неподдерживаемая симметрия " + symmetry);
+    }
+
+    // Комментарии и строка размеров
+    p = next_line(p);
+    while (p < end && (*p == '%' || *p == '\n' || *p == '\r')) {
+        p = next_line(p);
+    }
+    long long rows = 0, cols = 0, entries = 0;
+    {
+        std::istringstream size_stream(std::string(p, next_line(p)));
+        if (!(size_stream >> rows >> cols >> entries) || rows < 0 || cols < 0 || entries < 0 ||
+            rows > std::numeric_limits<Index>::max() || cols > std::numeric_limits<Index>::max()) {
+            throw format_error("строка размеров");
+        }
+        p = next_line(p);
+    }
+
+    // Разбиение тела файла на диапазоны байтов, выровненные на начало строк
+    size_t body = p - begin;
+    size_t chunk = (size - body + num_threads - 1) / num_threads;
+    std::vector<const char*> bounds(num_threads + 1, end);
+    bounds[0] = p;
+    for (unsigned t = 1; t < num_threads; ++t) {
+        size_t offset = std::min(size, body + t * chunk);
+        const char* s = begin + offset;
+        bounds[t] = (s == end || s[-1] == '\n') ? s : next_line(s);
+        bounds[t] = std::max(bounds[t], bounds[t - 1]);
+    }
+
+    // Разбор диапазонов: тройки (строка, столбец, значение), симметричные элементы дублируются
+    std::vector<std::vector<Index>> part_rows(num_threads), part_cols(num_threads);
+    std::vector<std::vector<Value>> part_values(num_threads);
+    std::vector<long long> part_lines(num_threads, 0);
+
+    run_threads(num_threads, [&](unsigned t) {
+        const char* s = bounds[t];
+        const char* stop = bounds[t + 1];
+        auto skip_blanks = [&] {
+            while (s < stop && (*s == ' ' || *s == '\t' || *s == '\r')) {
+                ++s;
+            }
+        };
+        auto& out_rows = part_rows[t];
+        auto& out_cols = part_cols[t];
+        auto& out_values = part_values[t];
+        size_t estimate = (stop - s) / 8;
+        out_rows.reserve(estimate);
+        out_cols.reserve(estimate);
+        out_values.reserve(estimate);
+
+        while (s < stop) {
+            skip_blanks();
+            if (s == stop || *s == '\n' || *s == '%') {
+                s = std::min(stop, next_line(s));
+                continue;
+            }
+
+            long long i = 0, j = 0;
+            double v = 1.0;
+            auto r = std::from_chars(s, stop, i);
+            s = r.ptr;
+            skip_blanks();
+            auto c = std::from_chars(s, stop, j);
+            s = c.ptr;
+            bool ok = r.ec == std::errc() && c.ec == std::errc();
+            if (!pattern) {
+                skip_blanks();
+                if (s < stop && *s == '+') {
+                    ++s;
+                }
+                auto f = std::from_chars(s, stop, v);
+                ok = ok && f.ec == std::errc();
+                s = f.ptr;
+            }
+            if (!ok || i < 1 || i > rows || j < 1 || j > cols) {
+                throw format_error("строка данных");
+            }
+
+            out_rows.push_back(static_cast<Index>(i - 1));
+            out_cols.push_back(static_cast<Index>(j - 1));
+            out_values.push_back(static_cast<Value>(v));
+            if ((symmetric || skew) && i != j) {
+                out_rows.push_back(static_cast<Index>(j - 1));
+                out_cols.push_back(static_cast<Index>(i - 1));
+                out_values.push_back(static_cast<Value>(skew ? -v : v));
+            }
+            part_lines[t]++;
+            s = std::min(stop, next_line(s));
+        }
+    });
+
+    long long parsed = 0;
+    for (long long n : part_lines) {
+        parsed += n;
+    }
+    if (parsed != entries) {
+        throw format_error("ожидалось " + std::to_string(entries) + " элементов, прочитано " + std::to_string(parsed));
+    }
+    mapping.reset();
+
+    // Подсчет элементов в строках
+    std::vector<std::atomic<Index>> row_count(rows);
+    for (auto& count : row_count) {
+        count.store(0, std::memory_order_relaxed);
+    }
+    run_threads(num_threads, [&](unsigned t) {
+        for (Index i : part_rows[t]) {
+            row_count[i].fetch_add(1, std::memory_order_relaxed);
+        }
+    });
+
+    std::vector<size_t> row_start(rows + 1, 0);
+    for (long long i = 0; i < rows; ++i) {
+        row_start[i + 1] = row_start[i] + row_count[i].load(std::memory_order_relaxed);
+        row_count[i].store(0, std::memory_order_relaxed);
+    }
+    if (row_start[rows] > static_cast<size_t>(std::numeric_limits<Index>::max())) {
+        throw format_error("число ненулевых элементов не помещается в тип индексов");
+    }
+
+    // Раскладка элементов по строкам
+    using Entry = MatrixMarketEntry<Index, Value>;
+    std::vector<Entry> row_entries(row_start[rows]);
+    run_threads(num_threads, [&](unsigned t) {
+        for (size_t k = 0; k < part_rows[t].size(); ++k) {
+            Index i = part_rows[t][k];
+            size_t pos = row_start[i] + row_count[i].fetch_add(1, std::memory_order_relaxed);
+            row_entries[pos] = {part_cols[t][k], part_values[t][k]};
+        }
+        std::vector<Index>().swap(part_rows[t]);
+        std::vector<Index>().swap(part_cols[t]);
+        std::vector<Value>().swap(part_values[t]);
+    });
+
+    // Сортировка столбцов внутри строк и суммирование повторяющихся элементов
+    BasicCSRMatrix<Index, Value> matrix(static_cast<Index>(rows), static_cast<Index>(cols));
+    auto row_range = [&](unsigned t) {
+        return std::make_pair(rows * t / num_threads, rows * (t + 1) / num_threads);
+    };
+
+    run_threads(num_threads, [&](unsigned t) {
+        auto [first, last] = row_range(t);
+        for (long long i = first; i < last; ++i) {
+            auto row_begin = row_entries.begin() + row_start[i];
+            auto row_end = row_entries.begin() + row_start[i + 1];
+            std::sort(row_begin, row_end, [](const Entry& a, const Entry& b) {
+                return a.col < b.col;
+            });
+            Index n = 0;
+            for (auto it = row_begin; it != row_end; ++it) {
+                if (n > 0 && row_begin[n - 1].col == it->col) {
+                    row_begin[n - 1].value += it->value;
+                } else {
+                    row_begin[n++] = *it;
+                }
+            }
+            matrix.row_ptr[i + 1] = n;
+        }
+    });
+
+    for (long long i = 0; i < rows; ++i) {
+        matrix.row_ptr[i + 1] += matrix.row_ptr[i];
+    }
+
+    matrix.non_zero_el = matrix.row_ptr[rows];
+    matrix.col_ind.resize(matrix.non_zero_el);
+    matrix.values.resize(matrix.non_zero_el);
+
+    run_threads(num_threads, [&](unsigned t) {
+        auto [first, last] = row_range(t);
+        for (long long i = first; i < last; ++i) {
+            size_t src = row_start[i];
+            for (Index k = matrix.row_ptr[i]; k < matrix.row_ptr[i + 1]; ++k, ++src) {
+                matrix.col_ind[k] = row_entries[src].col;
+                matrix.values[k] = row_entries[src].value;
+            }
+        }
+    });
+
+    return matrix;
+}
+
+template <class Index, class Value>
+BasicCSRMatrix<Index, Value> read_matrix(const std::string& filename) {
+    auto has_extension = [&](const std::string& ext) {
+        return filename.size() > ext.size() && filename.compare(filename.size() - ext.size(), ext.size(), ext) == 0;
+    };
+    if (has_extension(".mtx")) {
+        return read_matrix_market<Index, Value>(filename);
+    }
+    if (has_extension(".bin")) {
+        return MappedCSRMatrix(filename).to_matrix<Index, Value>();
+    }
+    return read_matrix_from_file<Index, Value>(filename);
+}
+
+// Нужна ли подгруппа на строку: при длинных строках рабочий элемент на строку читал бы
+// col_ind и values без объединения обращений соседних элементов
+static bool use_vector_kernel(size_t rows, size_t nnz, SpMVKernel kernel) {
+    if (kernel != SpMVKernel::automatic) {
+        return kernel == SpMVKernel::vector;
+    }
+    return rows > 0 && nnz >= static_cast<size_t>(SPMV_VECTOR_ROW_MIN) * rows;
+}
+
+// Число рабочих групп для ядра "подгруппа на строку" с проходом по строкам с шагом сетки
+static size_t vector_kernel_groups(size_t rows, size_t wg) {
+    return std::max<size_t>(1, std::min<size_t>((rows * 16 + wg - 1) / wg, 65536));
+}
+
+template <class Index, class Value>
+void sparse_matrix_vector_multiply(const BasicDeviceCSRMatrix<Index, Value>& A, const Value* x, Value* y,
+                                   queue& q, SpMVKernel kernel) {
+    if (A.rows == 0) {
+        return;
+    }
+
+    size_t rows = A.rows;
+    const Index* rp = A.row_ptr;
+    const Index* ci = A.col_ind;
+    const Value* val = A.values;
+
+    if (!use_vector_kernel(rows, A.nnz, kernel)) {
+        q.submit([&](handler& h) {
+            h.parallel_for(range<1>(rows), [=](id<1> ind) {
+                size_t i = ind[0];
+                Value sum = 0;
+                for (Index p = rp[i]; p < rp[i + 1]; ++p) {
+                    sum += val[p] * x[ci[p]];
+                }
+                y[i] = sum;
+            });
+        }).wait();
+        return;
+    }
+
+    size_t wg = std::min<size_t>(256, q.get_device().get_info<info::device::max_work_group_size>());
+    size_t groups = vector_kernel_groups(rows, wg);
+    q.submit([&](handler& h) {
+        h.parallel_for(nd_range<1>(range<1>(groups * wg), range<1>(wg)), [=](nd_item<1> it) {
+            auto sg = it.get_sub_group();
+            size_t lane = sg.get_local_linear_id();
+            size_t lanes = sg.get_local_linear_range();
+            size_t per_group = sg.get_group_range()[0];
+            size_t first = it.get_group(0) * per_group + sg.get_group_linear_id();
+            size_t stride = it.get_group_range(0) * per_group;
+
+            for (size_t i = first; i < rows; i += stride) {
+                Value sum = 0;
+                for (Index p = rp[i] + static_cast<Index>(lane); p < rp[i + 1]; p += static_cast<Index>(lanes)) {
+                    sum += val[p] * x[ci[p]];
+                }
+                sum = reduce_over_group(sg, sum, sycl::plus<Value>());
+                if (lane == 0) {
+                    y[i] = sum;
+                }
+            }
+        });
+    }).wait();
+}
+
+template <class Index, class Value>
+void sparse_matrix_dense_multiply(const BasicDeviceCSRMatrix<Index, Value>& A, const Value* X, Value* Y, size_t k,
+                                  queue& q, SpMVKernel kernel) {
+    if (A.rows == 0 || k == 0) {
+        return;
+    }
+
+    size_t rows = A.rows;
+    const Index* rp = A.row_ptr;
+    const Index* ci = A.col_ind;
+    const Value* val = A.values;
+    size_t blocks = (k + SPMM_BLOCK - 1) / SPMM_BLOCK;
+
+    // Рабочий элемент на пару (строка, блок из SPMM_BLOCK векторов)
+    if (!use_vector_kernel(rows, A.nnz, kernel)) {
+        q.submit([&](handler& h) {
+            h.parallel_for(range<1>(rows * blocks), [=](id<1> ind) {
+                size_t i = ind[0] / blocks;
+                size_t b = ind[0] % blocks * SPMM_BLOCK;
+                size_t kb = sycl::min<size_t>(SPMM_BLOCK, k - b);
+
+                Value acc[SPMM_BLOCK] = {};
+                for (Index p = rp[i]; p < rp[i + 1]; ++p) {
+                    Value a = val[p];
+                    const Value* x = X + static_cast<size_t>(ci[p]) * k + b;
+                    for (size_t j = 0; j < SPMM_BLOCK; ++j) {
+                        if (j < kb) {
+                            acc[j] += a * x[j];
+                        }
+                    }
+                }
+                for (size_t j = 0; j < kb; ++j) {
+                    Y[i * k + b + j] = acc[j];
+                }
+            });
+        }).wait();
+        return;
+    }
+
+    // Подгруппа на строку: элементы строки делятся между рабочими элементами, частичные
+    // суммы блока векторов складываются внутри подгруппы
+    size_t wg = std::min<size_t>(256, q.get_device().get_info<info::device::max_work_group_size>());
+    size_t groups = vector_kernel_groups(rows, wg);
+    q.submit([&](handler& h) {
+        h.parallel_for(nd_range<1>(range<1>(groups * wg), range<1>(wg)), [=](nd_item<1> it) {
+            auto sg = it.get_sub_group();
+            size_t lane = sg.get_local_linear_id();
+            size_t lanes = sg.get_local_linear_range();
+            size_t per_group = sg.get_group_range()[0];
+            size_t first = it.get_group(0) * per_group + sg.get_group_linear_id();
+            size_t stride = it.get_group_range(0) * per_group;
+
+            for (size_t i = first; i < rows; i += stride) {
+                for (size_t b = 0; b < k; b += SPMM_BLOCK) {
+                    size_t kb = sycl::min<size_t>(SPMM_BLOCK, k - b);
+
+                    Value acc[SPMM_BLOCK] = {};
+                    for (Index p = rp[i] + static_cast<Index>(lane); p < rp[i + 1]; p += static_cast<Index>(lanes)) {
+                        Value a = val[p];
+                        const Value* x = X + static_cast<size_t>(ci[p]) * k + b;
+                        for (size_t j = 0; j < SPMM_BLOCK; ++j) {
+                            if (j < kb) {
+                                acc[j] += a * x[j];
+                            }
+                        }
+                    }
+                    for (size_t j = 0; j < SPMM_BLOCK; ++j) {
+                        Value sum = reduce_over_group(sg, acc[j], sycl::plus<Value>());
+                        if (lane == 0 && j < kb) {
+                            Y[i * k + b + j] = sum;
+                        }
+                    }
+                }
+            }
+        });
+    }).wait();
+}
+
+template <class Index, class Value>
+void sparse_matrix_vector_multiply(const BasicCSRView<Index, Value>& A, const std::vector<Value>& x,
+                                   std::vector<Value>& y, queue& q, SpMVKernel kernel) {
+    if (x.size() != static_cast<size_t>(A.cols)) {
+        throw std::runtime_error("Длина вектора не совпадает с числом столбцов матрицы.");
+    }
+
+    BasicDeviceCSRMatrix<Index, Value> A_dev(A, q);
+    Value* x_dev = malloc_device<Value>(std::max<size_t>(x.size(), 1), q);
+    Value* y_dev = malloc_device<Value>(std::max<size_t>(A.rows, 1), q);
+    q.memcpy(x_dev, x.data(), x.size() * sizeof(Value)).wait();
+
+    sparse_matrix_vector_multiply(A_dev, x_dev, y_dev, q, kernel);
+
+    y.resize(A.rows);
+    q.memcpy(y.data(), y_dev, y.size() * sizeof(Value)).wait();
+    sycl::free(x_dev, q);
+    sycl::free(y_dev, q);
+}
+
+template <class Index, class Value>
+void sparse_matrix_dense_multiply(const BasicCSRView<Index, Value>& A, const std::vector<Value>& X,
+                                  std::vector<Value>& Y, size_t k, queue& q, SpMVKernel kernel) {
+    if (X.size() != static_cast<size_t>(A.cols) * k) {
+        throw std::runtime_error("Размер плотной матрицы не совпадает с числом столбцов разреженной.");
+    }
+
+    BasicDeviceCSRMatrix<Index, Value> A_dev(A, q);
+    Value* X_dev = malloc_device<Value>(std::max<size_t>(X.size(), 1), q);
+    Value* Y_dev = malloc_device<Value>(std::max<size_t>(static_cast<size_t>(A.rows) * k, 1), q);
+    q.memcpy(X_dev, X.data(), X.size() * sizeof(Value)).wait();
+
+    sparse_matrix_dense_multiply(A_dev, X_dev, Y_dev, k, q, kernel);
+
+    Y.resize(static_cast<size_t>(A.rows) * k);
+    q.memcpy(Y.data(), Y_dev, Y.size() * sizeof(Value)).wait();
+    sycl::free(X_dev, q);
+    sycl::free(Y_dev, q);
+}
+
+// Границы диапазонов строк для parts потоков с примерно равным числом ненулевых элементов
+template <class Index, class Value>
+static std::vector<Index> balanced_row_split(const BasicCSRView<Index, Value>& A, unsigned parts) {
+    std::vector<Index> bounds(parts + 1, A.rows);
+    bounds[0] = 0;
+    for (unsigned t = 1; t < parts; ++t) {
+        Index target = static_cast<Index>(A.nnz * t / parts);
+        bounds[t] = static_cast<Index>(std::lower_bound(A.row_ptr, A.row_ptr + A.rows + 1, target) - A.row_ptr);
+        bounds[t] = std::max(bounds[t], bounds[t - 1]);
+    }
+    return bounds;
+}
+
+static unsigned host_threads(unsigned num_threads) {
+    return num_threads != 0 ? num_threads : std::max(1u, std::thread::hardware_concurrency());
+}
+
+template <class Index, class Value>
+void sparse_matrix_vector_multiply_host(const BasicCSRView<Index, Value>& A, const Value* x, Value* y,
+                                        unsigned num_threads) {
+    num_threads = host_threads(num_threads);
+    std::vector<Index> bounds = balanced_row_split(A, num_threads);
+    const Index* rp = A.row_ptr;
+    const Index* ci = A.col_ind;
+    const Value* val = A.values;
+
+    run_threads(num_threads, [&](unsigned t) {
+        for (Index i = bounds[t]; i < bounds[t + 1]; ++i) {
+            Value sum = 0;
+#pragma omp simd reduction(+ : sum)
+            for (Index p = rp[i]; p < rp[i + 1]; ++p) {
+                sum += val[p] * x[ci[p]];
+            }
+            y[i] = sum;
+        }
+    });
+}
+
+template <class Index, class Value>
+void sparse_matrix_dense_multiply_host(const BasicCSRView<Index, Value>& A, const Value* X, Value* Y, size_t k,
+                                       unsigned num_threads) {
+    num_threads = host_threads(num_threads);
+    std::vector<Index> bounds = balanced_row_split(A, num_threads);
+    const Index* rp = A.row_ptr;
+    const Index* ci = A.col_ind;
+    const Value* val = A.values;
+
+    // Строка X по индексу столбца загружается один раз и умножается на все k векторов
+    run_threads(num_threads, [&](unsigned t) {
+        for (Index i = bounds[t]; i < bounds[t + 1]; ++i) {
+            Value* y = Y + static_cast<size_t>(i) * k;
+            std::fill(y, y + k, Value(0));
+            for (Index p = rp[i]; p < rp[i + 1]; ++p) {
+                Value a = val[p];
+                const Value* x = X + static_cast<size_t>(ci[p]) * k;
+#pragma omp simd
+                for (size_t j = 0; j < k; ++j) {
+                    y[j] += a * x[j];
+                }
+            }
+        }
+    });
+}
+
+std::vector<queue> make_numa_queues(const device& dev, bool profiling) {
+    property_list props = profiling ? property_list{property::queue::enable_profiling()} : property_list{};
+    std::vector<device> domains;
+    if (dev.get_info<info::device::partition_max_sub_devices>() > 1) {
+        try {
+            domains = dev.create_sub_devices<info::partition_property::partition_by_affinity_domain>(
+                info::partition_affinity_domain::numa);
+        } catch (const sycl::exception&) {
+            // Устройство не делится по доменам NUMA
+            domains.clear();
+        }
+    }
+    if (domains.empty()) {
+        domains.push_back(dev);
+    }
+
+    std::vector<queue> queues;
+    for (const auto& d : domains) {
+        queues.emplace_back(d, exception_handler, props);
+    }
+    return queues;
+}
+
+// Границы parts непрерывных диапазонов строк A с примерно равным числом произведений
+template <class Index, class Value>
+static std::vector<Index> flop_balanced_row_split(const BasicCSRView<Index, Value>& A,
+                                                  const BasicCSRView<Index, Value>& B, unsigned parts) {
+    std::vector<size_t> prefix(A.rows + 1, 0);
+    for (Index i = 0; i < A.rows; ++i) {
+        prefix[i + 1] = prefix[i] + row_flops(A, B, i);
+    }
+    std::vector<Index> bounds(parts + 1, A.rows);
+    bounds[0] = 0;
+    for (unsigned t = 1; t < parts; ++t) {
+        size_t target = prefix[A.rows] * t / parts;
+        bounds[t] = static_cast<Index>(std::lower_bound(prefix.begin(), prefix.end(), target) - prefix.begin());
+        bounds[t] = std::max(bounds[t], bounds[t - 1]);
+    }
+    return bounds;
+}
+
+// Статистика частей, выполнявшихся одновременно: время этапа - максимум по частям,
+// счетчики и память суммируются
+static void merge_concurrent_stats(MultiplyStats& stats, const MultiplyStats& part) {
+    stats.upload = std::max(stats.upload, part.upload);
+    stats.binning = std::max(stats.binning, part.binning);
+    stats.scan = std::max(stats.scan, part.scan);
+    stats.symbolic = std::max(stats.symbolic, part.symbolic);
+    stats.numeric = std::max(stats.numeric, part.numeric);
+    stats.transfer = std::max(stats.transfer, part.transfer);
+    stats.download = std::max(stats.download, part.download);
+    stats.bytes_to_device += part.bytes_to_device;
+    stats.bytes_from_device += part.bytes_from_device;
+    stats.products += part.products;
+    stats.nnz_C += part.nnz_C;
+    stats.peak_scratch_bytes += part.peak_scratch_bytes;
+    stats.overflow_rows += part.overflow_rows;
+    stats.device_timing = part.device_timing;
+    for (int b = 0; b < 3; ++b) {
+        stats.bins.rows[b] += part.bins.rows[b];
+        stats.bins.flops[b] += part.bins.flops[b];
+        stats.bins.max_flops[b] = std::max(stats.bins.max_flops[b], part.bins.max_flops[b]);
+    }
+}
+
+// Статистика последовательных умножений: времена этапов и счетчики суммируются
+static void merge_sequential_stats(MultiplyStats& stats, const MultiplyStats& part) {
+    MultiplyStats times = stats;
+    merge_concurrent_stats(stats, part);
+    stats.upload = times.upload + part.upload;
+    stats.binning = times.binning + part.binning;
+    stats.scan = times.scan + part.scan;
+    stats.symbolic = times.symbolic + part.symbolic;
+    stats.numeric = times.numeric + part.numeric;
+    stats.transfer = times.transfer + part.transfer;
+    stats.download = times.download + part.download;
+    stats.peak_scratch_bytes = std::max(times.peak_scratch_bytes, part.peak_scratch_bytes);
+}
+
+template <class Index, class Value>
+MultiplyStats sparse_matrix_multiply(const non_deduced_t<BasicCSRView<Index, Value>>& A,
+                                     const non_deduced_t<BasicCSRView<Index, Value>>& B,
+                                     BasicCSRMatrix<Index, Value>& C, std::vector<queue>& queues,
+                                     const SpGEMMBinning& binning) {
+    if (A.cols != B.rows) {
+        throw std::runtime_error("Размеры матриц не совпадают для умножения.");
+    }
+    if (queues.empty()) {
+        throw std::runtime_error("Не задано ни одной очереди.");
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    unsigned parts = static_cast<unsigned>(queues.size());
+    std::vector<Index> bounds = flop_balanced_row_split(A, B, parts);
+    std::vector<BasicCSRMatrix<Index, Value>> results(parts);
+    std::vector<MultiplyStats> part_stats(parts);
+
+    // Каждая очередь получает свои строки A и собственную копию B: память подустройства
+    // выделяется и заполняется из потока этой части
+    run_threads(parts, [&](unsigned t) {
+        queue& q = queues[t];
+        MultiplyStats& stats = part_stats[t];
+        std::vector<Index> panel_rp;
+        BasicCSRView<Index, Value> panel = row_panel(A, bounds[t], bounds[t + 1], panel_rp);
+
+        BasicDeviceCSRMatrix<Index, Value> A_dev(q);
+        BasicDeviceCSRMatrix<Index, Value> B_dev(q);
+        BasicDeviceCSRMatrix<Index, Value> C_dev(q);
+        PhaseTimer upload_timer(q);
+        stats.bytes_to_device += upload_matrix(panel, A_dev, q, upload_timer);
+        stats.bytes_to_device += upload_matrix(B, B_dev, q, upload_timer);
+        stats.upload = upload_timer.finish();
+
+        multiply_on_device(A_dev, B_dev, C_dev, q, binning, stats);
+        download_matrix(C_dev, results[t], q, stats);
+    });
+
+    MultiplyStats stats;
+    std::vector<size_t> offsets(parts + 1, 0);
+    for (unsigned t = 0; t < parts; ++t) {
+        merge_concurrent_stats(stats, part_stats[t]);
+        offsets[t + 1] = offsets[t] + results[t].col_ind.size();
+    }
+    if (offsets[parts] > static_cast<size_t>(std::numeric_limits<Index>::max())) {
+        throw std::runtime_error("nnz(C) не помещается в тип индекса.");
+    }
+    stats.panels = parts;
+
+    // Сшивка: сегменты row_ptr сдвигаются на nnz предыдущих частей, части копируются параллельно
+    auto stitch_start = std::chrono::steady_clock::now();
+    BasicCSRMatrix<Index, Value> result(A.rows, B.cols);
+    result.non_zero_el = static_cast<Index>(offsets[parts]);
+    result.col_ind.resize(offsets[parts]);
+    result.values.resize(offsets[parts]);
+    run_threads(parts, [&](unsigned t) {
+        const BasicCSRMatrix<Index, Value>& part = results[t];
+        Index shift = static_cast<Index>(offsets[t]);
+        for (Index i = 1; i <= bounds[t + 1] - bounds[t]; ++i) {
+            result.row_ptr[bounds[t] + i] = shift + part.row_ptr[i];
+        }
+        std::copy(part.col_ind.begin(), part.col_ind.end(), result.col_ind.begin() + offsets[t]);
+        std::copy(part.values.begin(), part.values.end(), result.values.begin() + offsets[t]);
+    });
+    C = std::move(result);
+    stats.download += std::chrono::duration<double>(std::chrono::steady_clock::now() - stitch_start).count();
+
+    stats.total = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    dump_stats_json(stats);
+    return stats;
+}
+
+template <class Index, class Value>
+MultiplyStats multiply_pipeline(
+    size_t count,
+    const std::function<std::pair<BasicCSRMatrix<Index, Value>, BasicCSRMatrix<Index, Value>>(size_t)>& load,
+    const std::function<void(size_t, BasicCSRMatrix<Index, Value>&)>& consume, queue& q,
+    const SpGEMMBinning& binning) {
+    auto start = std::chrono::steady_clock::now();
+    MultiplyStats stats;
+    if (count == 0) {
+        return stats;
+    }
+
+    // Пара i + 1 загружается, пока умножается пара i
+    auto next = std::async(std::launch::async, load, size_t(0));
+    for (size_t i = 0; i < count; ++i) {
+        auto wait_start = std::chrono::steady_clock::now();
+        auto [A, B] = next.get();
+        stats.load += std::chrono::duration<double>(std::chrono::steady_clock::now() - wait_start).count();
+        if (i + 1 < count) {
+            next = std::async(std::launch::async, load, i + 1);
+        }
+
+        BasicCSRMatrix<Index, Value> C;
+        merge_sequential_stats(stats, sparse_matrix_multiply(A, B, C, q, binning));
+        consume(i, C);
+    }
+
+    stats.total = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+}
+
+template <class Index, class Value>
+void BasicCSRBatch<Index, Value>::push_back(const BasicCSRView<Index, Value>& M) {
+    size_t base = col_ind.size();
+    if (base + M.nnz > static_cast<size_t>(std::numeric_limits<Index>::max())) {
+        throw std::runtime_error("Число элементов пакета не помещается в тип индекса.");
+    }
+    for (Index i = 1; i <= M.rows; ++i) {
+        row_ptr.push_back(static_cast<Index>(base) + M.row_ptr[i]);
+    }
+    col_ind.insert(col_ind.end(), M.col_ind, M.col_ind + M.nnz);
+    values.insert(values.end(), M.values, M.values + M.nnz);
+    row_offset.push_back(row_offset.back() + M.rows);
+    cols.push_back(M.cols);
+}
+
+template <class Index, class Value>
+BasicCSRMatrix<Index, Value> BasicCSRBatch<Index, Value>::matrix(size_t b) const {
+    Index r0 = row_offset[b];
+    Index base = row_ptr[r0];
+    BasicCSRMatrix<Index, Value> M(rows(b), cols[b]);
+    for (Index i = 1; i <= M.rows; ++i) {
+        M.row_ptr[i] = row_ptr[r0 + i] - base;
+    }
+    M.col_ind.assign(col_ind.begin() + base, col_ind.begin() + base + nnz(b));
+    M.values.assign(values.begin() + base, values.begin() + base + nnz(b));
+    M.non_zero_el = static_cast<Index>(M.col_ind.size());
+    return M;
+}
+
+// Копирование массива в память арены с учетом события копирования
+template <class T>
+static T* upload_array(const std::vector<T>& data, DeviceArena& arena, PhaseTimer& timer) {
+    T* ptr = arena.allocate<T>(data.size());
+    if (!data.empty()) {
+        timer.record(arena.get_queue().memcpy(ptr, data.data(), data.size() * sizeof(T)));
+    }
+    return ptr;
+}
+
+template <class Index, class Value>
+MultiplyStats sparse_matrix_multiply_batched(const BasicCSRBatch<Index, Value>& A, const BasicCSRBatch<Index, Value>& B,
+                                             BasicCSRBatch<Index, Value>& C, queue& q) {
+    if (A.size() != B.size()) {
+        throw std::runtime_error("Размеры пакетов не совпадают.");
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    MultiplyStats stats;
+    stats.device_timing = q.has_property<property::queue::enable_profiling>();
+    size_t count = A.size();
+    Index total_rows = A.row_offset.back();
+
+    // Раскладка аккумуляторов строк по верхней оценке flops; строка A_b с номером столбца k
+    // ссылается на строку B.row_offset[b] + k общего row_ptr пакета B
+    PhaseTimer binning_timer(q);
+    std::vector<size_t> acc_offset(total_rows + 1, 0);
+    Index max_rows = 0;
+    for (size_t b = 0; b < count; ++b) {
+        if (A.cols[b] != B.rows(b)) {
+            throw std::runtime_error("Размеры матриц пакета не совпадают для умножения.");
+        }
+        max_rows = std::max(max_rows, A.rows(b));
+        Index b_row0 = B.row_offset[b];
+        for (Index i = A.row_offset[b]; i < A.row_offset[b + 1]; ++i) {
+            size_t flops = 0;
+            for (Index r = A.row_ptr[i]; r < A.row_ptr[i + 1]; ++r) {
+                Index k = b_row0 + A.col_ind[r];
+                flops += B.row_ptr[k + 1] - B.row_ptr[k];
+            }
+            stats.products += flops;
+            acc_offset[i + 1] = acc_offset[i] + accumulator_size(flops, B.cols[b]);
+        }
+    }
+    stats.binning = binning_timer.finish();
+    size_t scratch_size = std::max<size_t>(acc_offset[total_rows], 1);
+    stats.peak_scratch_bytes = (total_rows + 1) * (sizeof(size_t) + sizeof(Index)) +
+                               scratch_size * (sizeof(Index) + sizeof(Value));
+
+    // Вся память устройства берется из арены и освобождается при выходе, в том числе по исключению
+    DeviceArena arena(q);
+    PhaseTimer upload_timer(q);
+    Index* a_rp = upload_array(A.row_ptr, arena, upload_timer);
+    Index* a_ci = upload_array(A.col_ind, arena, upload_timer);
+    Value* a_val = upload_array(A.values, arena, upload_timer);
+    Index* a_ro = upload_array(A.row_offset, arena, upload_timer);
+    Index* b_rp = upload_array(B.row_ptr, arena, upload_timer);
+    Index* b_ci = upload_array(B.col_ind, arena, upload_timer);
+    Value* b_val = upload_array(B.values, arena, upload_timer);
+    Index* b_ro = upload_array(B.row_offset, arena, upload_timer);
+    Index* b_cols = upload_array(B.cols, arena, upload_timer);
+    size_t* acc = upload_array(acc_offset, arena, upload_timer);
+    stats.upload = upload_timer.finish();
+    stats.bytes_to_device = (A.row_ptr.size() + A.col_ind.size() + A.row_offset.size() + B.row_ptr.size() +
+                             B.col_ind.size() + B.row_offset.size() + B.cols.size()) * sizeof(Index) +
+                            (A.values.size() + B.values.size()) * sizeof(Value) + acc_offset.size() * sizeof(size_t);
+
+    Index* keys = arena.allocate<Index>(scratch_size);
+    Value* sums = arena.allocate<Value>(scratch_size);
+    Index* c_rp = arena.allocate<Index>(total_rows + 1);
+
+    // Первый запуск: рабочая группа на пару матриц, рабочий элемент на строку A_b.
+    // Строка накапливается и сжимается в своем аккумуляторе, ее длина пишется в c_rp.
+    size_t wg = 1;
+    size_t max_wg = std::min<size_t>(256, q.get_device().get_info<info::device::max_work_group_size>());
+    while (wg < static_cast<size_t>(max_rows) && wg < max_wg) {
+        wg <<= 1;
+    }
+    PhaseTimer symbolic_timer(q);
+    if (count > 0 && total_rows > 0) {
+        symbolic_timer.record(q.submit([&](handler& h) {
+            h.parallel_for(nd_range<1>(range<1>(count * wg), range<1>(wg)), [=](nd_item<1> it) {
+                size_t b = it.get_group(0);
+                Index b_cols_b = b_cols[b];
+                Index* b_rows = b_rp + b_ro[b];
+                for (Index i = a_ro[b] + static_cast<Index>(it.get_local_id(0)); i < a_ro[b + 1];
+                     i += static_cast<Index>(wg)) {
+                    size_t off = acc[i];
+                    size_t size = acc[i + 1] - off;
+                    gustavson_accumulate(i, a_rp, a_ci, a_val, b_rows, b_ci, b_val, keys, sums, off, size, b_cols_b);
+                    c_rp[i] = static_cast<Index>(gustavson_compact(keys, sums, off, size, b_cols_b));
+                }
+            });
+        }));
+    }
+    stats.symbolic = symbolic_timer.finish();
+
+    // Длины строк на хост и префиксная сумма по всему пакету
+    BasicCSRBatch<Index, Value> result;
+    result.row_offset = A.row_offset;
+    result.cols = B.cols;
+    result.row_ptr.assign(total_rows + 1, 0);
+    PhaseTimer transfer_timer(q);
+    if (total_rows > 0) {
+        transfer_timer.record(q.memcpy(result.row_ptr.data() + 1, c_rp, total_rows * sizeof(Index)));
+    }
+    stats.transfer = transfer_timer.finish();
+    stats.bytes_from_device += total_rows * sizeof(Index);
+
+    auto scan_start = std::chrono::steady_clock::now();
+    size_t nnz_C = 0;
+    for (Index i = 1; i <= total_rows; ++i) {
+        nnz_C += result.row_ptr[i];
+        if (nnz_C > static_cast<size_t>(std::numeric_limits<Index>::max())) {
+            throw std::runtime_error("nnz(C) не помещается в тип индекса.");
+        }
+        result.row_ptr[i] = static_cast<Index>(nnz_C);
+    }
+    stats.scan = std::chrono::duration<double>(std::chrono::steady_clock::now() - scan_start).count();
+    stats.nnz_C = nnz_C;
+
+    // Второй запуск: перенос сжатых строк из аккумуляторов в общие массивы пакета C
+    Index* c_ci = arena.allocate<Index>(nnz_C);
+    Value* c_val = arena.allocate<Value>(nnz_C);
+    PhaseTimer numeric_timer(q);
+    if (nnz_C > 0) {
+        numeric_timer.record(q.memcpy(c_rp, result.row_ptr.data(), (total_rows + 1) * sizeof(Index)));
+        stats.bytes_to_device += (total_rows + 1) * sizeof(Index);
+        numeric_timer.record(q.submit([&](handler& h) {
+            h.parallel_for(range<1>(total_rows), [=](id<1> ind) {
+                size_t i = ind[0];
+                size_t off = acc[i];
+                Index start = c_rp[i];
+                for (Index k = 0; k < c_rp[i + 1] - start; ++k) {
+                    c_ci[start + k] = keys[off + k];
+                    c_val[start + k] = sums[off + k];
+                }
+            });
+        }));
+    }
+    stats.numeric = numeric_timer.finish();
+
+    PhaseTimer download_timer(q);
+    result.col_ind.resize(nnz_C);
+    result.values.resize(nnz_C);
+    if (nnz_C > 0) {
+        download_timer.record(q.memcpy(result.col_ind.data(), c_ci, nnz_C * sizeof(Index)));
+        download_timer.record(q.memcpy(result.values.data(), c_val, nnz_C * sizeof(Value)));
+    }
+    stats.download = download_timer.finish();
+    stats.bytes_from_device += nnz_C * (sizeof(Index) + sizeof(Value));
+    C = std::move(result);
+
+    stats.total = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    dump_stats_json(stats);
+    return stats;
+}
+
+// Выбор формы маскированного умножения по оценке числа операций: скалярные произведения
+// стоят |A_i| + |B^T_j| сравнений на элемент маски, форма Густавсона - flops строки,
+// умноженные на двоичный поиск по строке маски
+template <class Index, class Value>
+static bool use_dot_masked(const BasicCSRView<Index, Value>& M, const BasicCSRView<Index, Value>& A,
+                           const BasicCSRView<Index, Value>& B, size_t& products) {
+    std::vector<size_t> b_col_count(B.cols, 0);
+    for (size_t p = 0; p < B.nnz; ++p) {
+        ++b_col_count[B.col_ind[p]];
+    }
+
+    double dot_cost = 0;
+    double gustavson_cost = 0;
+    products = 0;
+    for (Index i = 0; i < M.rows; ++i) {
+        size_t a_len = A.row_ptr[i + 1] - A.row_ptr[i];
+        size_t m_len = M.row_ptr[i + 1] - M.row_ptr[i];
+        for (Index p = M.row_ptr[i]; p < M.row_ptr[i + 1]; ++p) {
+            dot_cost += a_len + b_col_count[M.col_ind[p]];
+        }
+        size_t flops = row_flops(A, B, i);
+        products += flops;
+        gustavson_cost += flops * std::log2(m_len + 2.0);
+    }
+    return dot_cost < gustavson_cost;
+}
+
+template <class Index, class Value>
+MultiplyStats sparse_matrix_multiply_masked(const non_deduced_t<BasicCSRView<Index, Value>>& M,
+                                            const non_deduced_t<BasicCSRView<Index, Value>>& A,
+                                            const BasicCSRMatrix<Index, Value>& B, BasicCSRMatrix<Index, Value>& C,
+                                            queue& q, MaskedSpGEMMKernel kernel) {
+    if (A.cols != B.rows || M.rows != A.rows || M.cols != B.cols) {
+        throw std::runtime_error("Размеры матриц не совпадают для маскированного умножения.");
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    MultiplyStats stats;
+    stats.device_timing = q.has_property<property::queue::enable_profiling>();
+
+    size_t products = 0;
+    bool dot = use_dot_masked(M, A, BasicCSRView<Index, Value>(B), products);
+    if (kernel != MaskedSpGEMMKernel::automatic) {
+        dot = kernel == MaskedSpGEMMKernel::dot;
+    }
+    stats.products = products;
+
+    // Для скалярных произведений нужны столбцы B, то есть строки кэшированной B^T
+    BasicDeviceCSRMatrix<Index, Value> M_dev(q);
+    BasicDeviceCSRMatrix<Index, Value> A_dev(q);
+    BasicDeviceCSRMatrix<Index, Value> B_dev(q);
+    BasicDeviceCSRMatrix<Index, Value> C_dev(q);
+    PhaseTimer upload_timer(q);
+    stats.bytes_to_device += upload_matrix(M, M_dev, q, upload_timer);
+    stats.bytes_to_device += upload_matrix(A, A_dev, q, upload_timer);
+    stats.bytes_to_device += upload_matrix(BasicCSRView<Index, Value>(dot ? B.transposed(q) : B), B_dev, q,
+                                           upload_timer);
+    stats.upload = upload_timer.finish();
+
+    Index ro = M.rows;
+    size_t m_nnz = M.nnz;
+    const Index* m_rp = M_dev.row_ptr;
+    const Index* m_ci = M_dev.col_ind;
+    const Index* a_rp = A_dev.row_ptr;
+    const Index* a_ci = A_dev.col_ind;
+    const Value* a_val = A_dev.values;
+    const Index* b_rp = B_dev.row_ptr;
+    const Index* b_ci = B_dev.col_ind;
+    const Value* b_val = B_dev.values;
+
+    // Значения A·B во всех позициях маски
+    SpGEMMScratch<Index, Value> scratch(q);
+    Value* sums = scratch.sums(std::max<size_t>(m_nnz, 1));
+    stats.peak_scratch_bytes = std::max<size_t>(m_nnz, 1) * sizeof(Value);
+    PhaseTimer numeric_timer(q);
+    if (m_nnz > 0 && dot) {
+        // Элемент маски на рабочий элемент: строка находится двоичным поиском по row_ptr,
+        // значение - слиянием упорядоченных строк A_i и B^T_j
+        numeric_timer.record(q.submit([&](handler& h) {
+            h.parallel_for(range<1>(m_nnz), [=](id<1> ind) {
+                Index e = static_cast<Index>(ind[0]);
+                Index lo = 0, hi = ro - 1;
+                while (lo < hi) {
+                    Index mid = lo + (hi - lo + 1) / 2;
+                    if (m_rp[mid] <= e) {
+                        lo = mid;
+                    } else {
+                        hi = mid - 1;
+                    }
+                }
+                Index j = m_ci[e];
+                Index p = a_rp[lo], p_end = a_rp[lo + 1];
+                Index r = b_rp[j], r_end = b_rp[j + 1];
+                Value sum = 0;
+                while (p < p_end && r < r_end) {
+                    Index ca = a_ci[p], cb = b_ci[r];
+                    if (ca < cb) {
+                        ++p;
+                    } else if (cb < ca) {
+                        ++r;
+                    } else {
+                        sum += a_val[p++] * b_val[r++];
+                    }
+                }
+                sums[e] = sum;
+            });
+        }));
+    } else if (m_nnz > 0) {
+        // Строка на рабочий элемент: произведения, не попавшие в строку маски, пропускаются
+        numeric_timer.record(q.fill(sums, Value(0), m_nnz)).wait();
+        numeric_timer.record(q.submit([&](handler& h) {
+            h.parallel_for(range<1>(ro), [=](id<1> ind) {
+                size_t i = ind[0];
+                Index m_begin = m_rp[i], m_end = m_rp[i + 1];
+                if (m_begin == m_end) {
+                    return;
+                }
+                for (Index p = a_rp[i]; p < a_rp[i + 1]; ++p) {
+                    Index k = a_ci[p];
+                    Value a = a_val[p];
+                    for (Index r = b_rp[k]; r < b_rp[k + 1]; ++r) {
+                        Index j = b_ci[r];
+                        Index lo = m_begin, hi = m_end;
+                        while (lo < hi) {
+                            Index mid = lo + (hi - lo) / 2;
+                            if (m_ci[mid] < j) {
+                                lo = mid + 1;
+                            } else {
+                                hi = mid;
+                            }
+                        }
+                        if (lo < m_end && m_ci[lo] == j) {
+                            sums[lo] += a * b_val[r];
+                        }
+                    }
+                }
+            });
+        }));
+    }
+    stats.numeric = numeric_timer.finish();
+
+    // Сжатие: в C остаются позиции маски с ненулевым значением, как и в немаскированном A·B
+    C_dev.allocate_rows(ro, M.cols);
+    Index* c_rp = C_dev.row_ptr;
+    PhaseTimer symbolic_timer(q);
+    symbolic_timer.record(q.fill(c_rp, Index(0), ro + 1)).wait();
+    if (m_nnz > 0) {
+        symbolic_timer.record(q.submit([&](handler& h) {
+            h.parallel_for(range<1>(ro), [=](id<1> ind) {
+                size_t i = ind[0];
+                Index count = 0;
+                for (Index e = m_rp[i]; e < m_rp[i + 1]; ++e) {
+                    count += is_nonzero(sums[e]) ? 1 : 0;
+                }
+                c_rp[i] = count;
+            });
+        }));
+    }
+    stats.symbolic = symbolic_timer.finish();
+
+    PhaseTimer scan_timer(q);
+    exclusive_scan_device(c_rp, ro + 1, scratch.template scan_temp<Index>(ro + 1), q, scan_timer.sink());
+    stats.scan = scan_timer.finish();
+
+    Index nnz_C = 0;
+    PhaseTimer transfer_timer(q);
+    transfer_timer.record(q.memcpy(&nnz_C, c_rp + ro, sizeof(Index)));
+    stats.transfer = transfer_timer.finish();
+    stats.bytes_from_device += sizeof(Index);
+    stats.nnz_C = nnz_C;
+
+    C_dev.allocate_nnz(nnz_C);
+    Index* c_ci = C_dev.col_ind;
+    Value* c_val = C_dev.values;
+    if (nnz_C > 0) {
+        numeric_timer = PhaseTimer(q);
+        numeric_timer.record(q.submit([&](handler& h) {
+            h.parallel_for(range<1>(ro), [=](id<1> ind) {
+                size_t i = ind[0];
+                Index pos = c_rp[i];
+                for (Index e = m_rp[i]; e < m_rp[i + 1]; ++e) {
+                    if (is_nonzero(sums[e])) {
+                        c_ci[pos] = m_ci[e];
+                        c_val[pos] = sums[e];
+                        ++pos;
+                    }
+                }
+            });
+        }));
+        stats.numeric += numeric_timer.finish();
+    }
+
+    download_matrix(C_dev, C, q, stats);
+    stats.total = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    dump_stats_json(stats);
+    return stats;
+}
+
+template <class Index, class Value>
+BasicCSRMatrix<Index, Value> undirected_lower_triangle(const BasicCSRView<Index, Value>& A) {
+    if (A.rows != A.cols) {
+        throw std::runtime_error("Матрица смежности должна быть квадратной.");
+    }
+
+    // Ребро (i, j) из A или A^T попадает в строку max(i, j) со столбцом min(i, j)
+    std::vector<Index> count(A.rows + 1, 0);
+    for (Index i = 0; i < A.rows; ++i) {
+        for (Index p = A.row_ptr[i]; p < A.row_ptr[i + 1]; ++p) {
+            Index j = A.col_ind[p];
+            if (i != j) {
+                ++count[std::max(i, j) + 1];
+            }
+        }
+    }
+    for (Index i = 0; i < A.rows; ++i) {
+        count[i + 1] += count[i];
+    }
+    std::vector<Index> cols(count[A.rows]);
+    std::vector<Index> pos(count.begin(), count.end() - 1);
+    for (Index i = 0; i < A.rows; ++i) {
+        for (Index p = A.row_ptr[i]; p < A.row_ptr[i + 1]; ++p) {
+            Index j = A.col_ind[p];
+            if (i != j) {
+                cols[pos[std::max(i, j)]++] = std::min(i, j);
+            }
+        }
+    }
+
+    BasicCSRMatrix<Index, Value> L(A.rows, A.cols);
+    L.col_ind.reserve(cols.size());
+    for (Index i = 0; i < A.rows; ++i) {
+        auto first = cols.begin() + count[i];
+        auto last = cols.begin() + count[i + 1];
+        std::sort(first, last);
+        last = std::unique(first, last);
+        L.col_ind.insert(L.col_ind.end(), first, last);
+        L.row_ptr[i + 1] = static_cast<Index>(L.col_ind.size());
+    }
+    L.values.assign(L.col_ind.size(), Value(1));
+    L.non_zero_el = static_cast<Index>(L.col_ind.size());
+    return L;
+}
+
+template <class Index, class Value>
+size_t count_triangles(const BasicCSRView<Index, Value>& A, queue& q, MaskedSpGEMMKernel kernel) {
+    BasicCSRMatrix<Index, Value> L = undirected_lower_triangle(A);
+    BasicCSRMatrix<Index, Value> C;
+    sparse_matrix_multiply_masked(L, L, L, C, q, kernel);
+
+    size_t triangles = 0;
+    for (Value v : C.values) {
+        triangles += static_cast<size_t>(std::llround(v));
+    }
+    return triangles;
+}
+
+// Симметризованная структура квадратной матрицы без диагонали: смежность A + A^T
+template <class Index, class Value>
+static void symmetric_pattern(const BasicCSRView<Index, Value>& A, std::vector<Index>& adj_ptr,
+                              std::vector<Index>& adj) {
+    adj_ptr.assign(A.rows + 1, 0);
+    for (Index i = 0; i < A.rows; ++i) {
+        for (Index p = A.row_ptr[i]; p < A.row_ptr[i + 1]; ++p) {
+            Index j = A.col_ind[p];
+            if (i != j) {
+                ++adj_ptr[i + 1];
+                ++adj_ptr[j + 1];
+            }
+        }
+    }
+    for (Index i = 0; i < A.rows; ++i) {
+        adj_ptr[i + 1] += adj_ptr[i];
+    }
+    adj.resize(adj_ptr[A.rows]);
+    std::vector<Index> pos(adj_ptr.begin(), adj_ptr.end() - 1);
+    for (Index i = 0; i < A.rows; ++i) {
+        for (Index p = A.row_ptr[i]; p < A.row_ptr[i + 1]; ++p) {
+            Index j = A.col_ind[p];
+            if (i != j) {
+                adj[pos[i]++] = j;
+                adj[pos[j]++] = i;
+            }
+        }
+    }
+
+    // Повторы (пары, заданные и в A, и в A^T) удаляются со сжатием массивов
+    Index out = 0;
+    for (Index i = 0; i < A.rows; ++i) {
+        auto first = adj.begin() + adj_ptr[i];
+        auto last = adj.begin() + adj_ptr[i + 1];
+        std::sort(first, last);
+        last = std::unique(first, last);
+        adj_ptr[i] = out;
+        out = static_cast<Index>(std::copy(first, last, adj.begin() + out) - adj.begin());
+    }
+    adj_ptr[A.rows] = out;
+    adj.resize(out);
+}
+
+// Обратный порядок Катхилл-Макки: обход в ширину каждой компоненты связности от
+// псевдопериферийной вершины, соседи добавляются по возрастанию степени
+template <class Index>
+static std::vector<Index> reverse_cuthill_mckee(const std::vector<Index>& adj_ptr, const std::vector<Index>& adj) {
+    Index n = static_cast<Index>(adj_ptr.size()) - 1;
+    auto degree = [&](Index v) { return adj_ptr[v + 1] - adj_ptr[v]; };
+    auto by_degree = [&](Index a, Index b) { return degree(a) < degree(b); };
+
+    std::vector<Index> order;
+    order.reserve(n);
+    std::vector<Index> level(n, -1);
+    std::vector<char> visited(n, 0);
+    std::vector<Index> vertices(n);
+    for (Index v = 0; v < n; ++v) {
+        vertices[v] = v;
+    }
+    std::stable_sort(vertices.begin(), vertices.end(), by_degree);
+
+    // Обход в ширину по непосещенным вершинам от root: вершины в порядке обхода в frontier,
+    // возвращается вершина наименьшей степени на последнем уровне и глубина обхода
+    std::vector<Index> frontier;
+    auto bfs = [&](Index root, Index& depth) {
+        frontier.assign(1, root);
+        level[root] = 0;
+        for (size_t head = 0; head < frontier.size(); ++head) {
+            Index v = frontier[head];
+            size_t first_new = frontier.size();
+            for (Index p = adj_ptr[v]; p < adj_ptr[v + 1]; ++p) {
+                Index u = adj[p];
+                if (!visited[u] && level[u] < 0) {
+                    level[u] = level[v] + 1;
+                    frontier.push_back(u);
+                }
+            }
+            std::stable_sort(frontier.begin() + first_new, frontier.end(), by_degree);
+        }
+        depth = level[frontier.back()];
+        Index farthest = frontier.back();
+        for (Index v : frontier) {
+            if (level[v] == depth && degree(v) < degree(farthest)) {
+                farthest = v;
+            }
+            level[v] = -1;
+        }
+        return farthest;
+    };
+
+    for (Index start : vertices) {
+        if (visited[start]) {
+            continue;
+        }
+        // Псевдопериферийная вершина: переход в дальнюю вершину, пока глубина обхода растет
+        Index root = start;
+        Index depth = 0;
+        Index farthest = bfs(root, depth);
+        for (int iter = 0; iter < 4; ++iter) {
+            Index candidate_depth = 0;
+            Index next = bfs(farthest, candidate_depth);
+            if (candidate_depth <= depth) {
+                break;
+            }
+            root = farthest;
+            depth = candidate_depth;
+            farthest = next;
+        }
+        Index unused = 0;
+        bfs(root, unused);
+        for (Index v : frontier) {
+            visited[v] = 1;
+        }
+        order.insert(order.end(), frontier.begin(), frontier.end());
+    }
+    std::reverse(order.begin(), order.end());
+    return order;
+}
+
+template <class Index, class Value>
+MatrixPermutation<Index> compute_reordering(const BasicCSRView<Index, Value>& A, Reordering method) {
+    MatrixPermutation<Index> perm;
+    if (method == Reordering::none) {
+        return perm;
+    }
+
+    if (method == Reordering::row_length) {
+        perm.rows.resize(A.rows);
+        for (Index i = 0; i < A.rows; ++i) {
+            perm.rows[i] = i;
+        }
+        std::stable_sort(perm.rows.begin(), perm.rows.end(), [&](Index a, Index b) {
+            return A.row_ptr[a + 1] - A.row_ptr[a] > A.row_ptr[b + 1] - A.row_ptr[b];
+        });
+        return perm;
+    }
+
+    if (A.rows != A.cols) {
+        throw std::runtime_error("Симметричное переупорядочивание требует квадратной матрицы.");
+    }
+    if (method == Reordering::rcm) {
+        std::vector<Index> adj_ptr, adj;
+        symmetric_pattern(A, adj_ptr, adj);
+        perm.rows = reverse_cuthill_mckee(adj_ptr, adj);
+    } else {
+        // Степень вершины - сумма длины строки и числа элементов в столбце
+        std::vector<size_t> degree(A.rows, 0);
+        for (Index i = 0; i < A.rows; ++i) {
+            degree[i] += A.row_ptr[i + 1] - A.row_ptr[i];
+        }
+        for (size_t p = 0; p < A.nnz; ++p) {
+            ++degree[A.col_ind[p]];
+        }
+        perm.rows.resize(A.rows);
+        for (Index i = 0; i < A.rows; ++i) {
+            perm.rows[i] = i;
+        }
+        std::stable_sort(perm.rows.begin(), perm.rows.end(),
+                         [&](Index a, Index b) { return degree[a] > degree[b]; });
+    }
+    perm.cols = perm.rows;
+    return perm;
+}
+
+// Обратная перестановка: old -> new (пустая остается пустой)
+template <class Index>
+static std::vector<Index> inverse_permutation(const std::vector<Index>& perm) {
+    std::vector<Index> inverse(perm.size());
+    for (size_t k = 0; k < perm.size(); ++k) {
+        inverse[perm[k]] = static_cast<Index>(k);
+    }
+    return inverse;
+}
+
+template <class Index, class Value>
+BasicCSRMatrix<Index, Value> permute_matrix(const BasicCSRView<Index, Value>& A, const MatrixPermutation<Index>& perm) {
+    if ((!perm.rows.empty() && perm.rows.size() != static_cast<size_t>(A.rows)) ||
+        (!perm.cols.empty() && perm.cols.size() != static_cast<size_t>(A.cols))) {
+        throw std::runtime_error("Размер перестановки не совпадает с размером матрицы.");
+    }
+    std::vector<Index> new_col = inverse_permutation(perm.cols);
+    auto old_row = [&](Index i) { return perm.rows.empty() ? i : perm.rows[i]; };
+
+    BasicCSRMatrix<Index, Value> M(A.rows, A.cols);
+    for (Index i = 0; i < A.rows; ++i) {
+        Index r = old_row(i);
+        M.row_ptr[i + 1] = M.row_ptr[i] + (A.row_ptr[r + 1] - A.row_ptr[r]);
+    }
+    M.col_ind.resize(A.nnz);
+    M.values.resize(A.nnz);
+    M.non_zero_el = static_cast<Index>(A.nnz);
+
+    // Строки переносятся параллельно; после перенумерации столбцов строка сортируется
+    unsigned num_threads = host_threads(0);
+    std::vector<Index> bounds = balanced_row_split(BasicCSRView<Index, Value>(M), num_threads);
+    run_threads(num_threads, [&](unsigned t) {
+        std::vector<std::pair<Index, Value>> row;
+        for (Index i = bounds[t]; i < bounds[t + 1]; ++i) {
+            Index r = old_row(i);
+            row.clear();
+            for (Index p = A.row_ptr[r]; p < A.row_ptr[r + 1]; ++p) {
+                Index c = A.col_ind[p];
+                row.emplace_back(new_col.empty() ? c : new_col[c], A.values[p]);
+            }
+            if (!new_col.empty()) {
+                std::sort(row.begin(), row.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+            }
+            for (size_t k = 0; k < row.size(); ++k) {
+                M.col_ind[M.row_ptr[i] + k] = row[k].first;
+                M.values[M.row_ptr[i] + k] = row[k].second;
+            }
+        }
+    });
+    return M;
+}
+
+template <class Index, class Value>
+MultiplyStats sparse_matrix_multiply_reordered(const non_deduced_t<BasicCSRView<Index, Value>>& A,
+                                               const non_deduced_t<BasicCSRView<Index, Value>>& B,
+                                               BasicCSRMatrix<Index, Value>& C, queue& q, Reordering method,
+                                               MatrixPermutation<Index>* c_perm, const SpGEMMBinning& binning) {
+    if (A.cols != B.rows) {
         throw std::runtime_error("Размеры матриц не совпадают для умножения.");
     }
 
-    // Результирующая матрица
-    C.rows = A.rows;
-    C.cols = B1.cols;
-    C.non_zero_el = 0;
-    C.row_ptr.resize(A.rows + 1);
-    int ro = A.rows;
+    // A' = P A Q^T, B' = Q B R^T; R совпадает с Q, если B квадратная того же размера
+    auto start = std::chrono::steady_clock::now();
+    MatrixPermutation<Index> a_perm = compute_reordering(A, method);
+    MatrixPermutation<Index> b_perm;
+    b_perm.rows = a_perm.cols;
+    if (B.rows == B.cols) {
+        b_perm.cols = a_perm.cols;
+    }
+    BasicCSRMatrix<Index, Value> A_perm = permute_matrix(A, a_perm);
+    BasicCSRMatrix<Index, Value> B_perm = permute_matrix(B, b_perm);
+    double reorder = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    BasicCSRMatrix<Index, Value> C_perm;
+    MultiplyStats stats = sparse_matrix_multiply(A_perm, B_perm, C_perm, q, binning);
 
-    CSRMatrix B = B1.transpose();
+    // C = P^T C' R
+    auto back_start = std::chrono::steady_clock::now();
+    if (c_perm != nullptr) {
+        c_perm->rows = a_perm.rows;
+        c_perm->cols = b_perm.cols;
+        C = std::move(C_perm);
+    } else {
+        MatrixPermutation<Index> back;
+        back.rows = inverse_permutation(a_perm.rows);
+        back.cols = inverse_permutation(b_perm.cols);
+        C = permute_matrix(C_perm, back);
+    }
+    stats.reorder = reorder + std::chrono::duration<double>(std::chrono::steady_clock::now() - back_start).count();
+    stats.total = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+}
 
-    int ro2 = B.rows;
+// Вызов f(std::integral_constant<int, B>()) для B == block из списка размеров: ядра BSR
+// компилируются отдельно для каждого размера блока из BSR_BLOCK_SIZES
+template <int First, int... Rest, class F>
+static void dispatch_block_size(int block, F& f) {
+    if (block == First) {
+        f(std::integral_constant<int, First>());
+    } else if constexpr (sizeof...(Rest) > 0) {
+        dispatch_block_size<Rest...>(block, f);
+    } else {
+        throw std::runtime_error("Размер блока BSR не входит в BSR_BLOCK_SIZES.");
+    }
+}
 
-    // Используем буферы для передачи данных на устройство
-    buffer<int, 1> buf_row_ptr_A(A.row_ptr.data(), range<1>(A.row_ptr.size()));
-    buffer<int, 1> buf_col_ind_A(A.col_ind.data(), range<1>(A.col_ind.size()));
-    buffer<double, 1> buf_values_A(A.values.data(), range<1>(A.values.size()));
-    buffer<int, 1> buf_non_zero_el_A(&A.non_zero_el, range<1>(1));
+// c += a * b для плотных блоков Bs x Bs, хранящихся по строкам: внутренний цикл идет по
+// строке b и c с шагом 1 и векторизуется
+template <int Bs, class Value>
+inline void block_multiply_add(const Value* a, const Value* b, Value* c) {
+    for (int r = 0; r < Bs; ++r) {
+        for (int k = 0; k < Bs; ++k) {
+            Value ark = a[r * Bs + k];
+            for (int j = 0; j < Bs; ++j) {
+                c[r * Bs + j] += ark * b[k * Bs + j];
+            }
+        }
+    }
+}
 
-    buffer<int, 1> buf_row_ptr_B(B.row_ptr.data(), range<1>(B.row_ptr.size()));
-    buffer<int, 1> buf_col_ind_B(B.col_ind.data(), range<1>(B.col_ind.size()));
-    buffer<double, 1> buf_values_B(B.values.data(), range<1>(B.values.size()));
-    buffer<int, 1> buf_non_zero_el_B(&B.non_zero_el, range<1>(1));
+// Число ненулевых блоков в каждой блочной строке A при размере блока block
+template <class Index, class Value>
+static std::vector<Index> count_bsr_blocks(const BasicCSRView<Index, Value>& A, int block) {
+    Index block_rows = (A.rows + block - 1) / block;
+    Index block_cols = (A.cols + block - 1) / block;
+    std::vector<Index> counts(block_rows, 0);
 
-    buffer<int, 1> buf_row_ptr_C(C.row_ptr.data(), range<1>(C.row_ptr.size()));
+    unsigned num_threads = host_threads(0);
+    run_threads(num_threads, [&](unsigned t) {
+        // seen[bc] - последняя блочная строка, в которой встретился блочный столбец bc
+        std::vector<Index> seen(block_cols, -1);
+        Index b0 = static_cast<Index>(static_cast<size_t>(block_rows) * t / num_threads);
+        Index b1 = static_cast<Index>(static_cast<size_t>(block_rows) * (t + 1) / num_threads);
+        for (Index bi = b0; bi < b1; ++bi) {
+            Index row_end = std::min<Index>(A.rows, (bi + 1) * block);
+            for (Index i = bi * block; i < row_end; ++i) {
+                for (Index p = A.row_ptr[i]; p < A.row_ptr[i + 1]; ++p) {
+                    Index bc = A.col_ind[p] / block;
+                    if (seen[bc] != bi) {
+                        seen[bc] = bi;
+                        ++counts[bi];
+                    }
+                }
+            }
+        }
+    });
+    return counts;
+}
 
-    // Параллельное умножение разреженных матриц
-    q.submit([&](handler& h) {
-        // Использование аксессоров
-        accessor acc_row_ptr_A = buf_row_ptr_A.get_access<access::mode::read>(h);
-        accessor acc_col_ind_A = buf_col_ind_A.get_access<access::mode::read>(h);
-        accessor acc_values_A = buf_values_A.get_access<access::mode::read>(h);
-        accessor acc_non_zero_el_A = buf_non_zero_el_A.get_access<access::mode::read>(h);
+template <class Index, class Value>
+double bsr_fill_ratio(const BasicCSRView<Index, Value>& A, int block) {
+    if (block < 1) {
+        throw std::runtime_error("Размер блока BSR должен быть положительным.");
+    }
+    if (A.nnz == 0) {
+        return 1.0;
+    }
+    size_t blocks = 0;
+    for (Index count : count_bsr_blocks(A, block)) {
+        blocks += count;
+    }
+    return static_cast<double>(blocks) * block * block / A.nnz;
+}
 
-        accessor acc_row_ptr_B = buf_row_ptr_B.get_access<access::mode::read>(h);
-        accessor acc_col_ind_B = buf_col_ind_B.get_access<access::mode::read>(h);
-        accessor acc_values_B = buf_values_B.get_access<access::mode::read>(h);
-        accessor acc_non_zero_el_B = buf_non_zero_el_B.get_access<access::mode::read>(h);
+template <class Index, class Value>
+int detect_block_size(const BasicCSRView<Index, Value>& A, double max_fill) {
+    const int sizes[] = {BSR_BLOCK_SIZES};
+    for (int k = sizeof(sizes) / sizeof(sizes[0]) - 1; k >= 0; --k) {
+        int block = sizes[k];
+        if (block > 1 && block <= std::min(A.rows, A.cols) && bsr_fill_ratio(A, block) <= max_fill) {
+            return block;
+        }
+    }
+    return 1;
+}
 
-        accessor acc_row_ptr_C = buf_row_ptr_C.get_access<access::mode::write>(h);
+template <class Index, class Value>
+double BasicBSRMatrix<Index, Value>::fill_ratio() const {
+    size_t nonzero = 0;
+    for (Value v : values) {
+        nonzero += is_nonzero(v) ? 1 : 0;
+    }
+    return nonzero > 0 ? static_cast<double>(values.size()) / nonzero : 1.0;
+}
 
-        h.parallel_for(range<1>(ro), [=](id<1> ind) {
-            size_t i = ind[0] + 1;
-            int k = 0;
-            
-            for (int bpos = 1; bpos < ro2 + 1; ++bpos) {
-                double sum = 0;
-                for (int r = acc_row_ptr_A[i - 1]; r < acc_row_ptr_A[i]; ++r) {
-                    for (int j = acc_row_ptr_B[bpos - 1]; j < acc_row_ptr_B[bpos]; ++j) {
-                        if (acc_col_ind_B[j] == acc_col_ind_A[r]) {
-                            sum += acc_values_A[r] * acc_values_B[j];
-                        }
+template <class Index, class Value>
+BasicBSRMatrix<Index, Value> csr_to_bsr(const BasicCSRView<Index, Value>& A, int block) {
+    if (block == 0) {
+        block = detect_block_size(A);
+    }
+    if (block < 1) {
+        throw std::runtime_error("Размер блока BSR должен быть положительным.");
+    }
+
+    BasicBSRMatrix<Index, Value> M(A.rows, A.cols, block);
+    Index block_rows = M.block_rows();
+    std::vector<Index> counts = count_bsr_blocks(A, block);
+    for (Index bi = 0; bi < block_rows; ++bi) {
+        M.row_ptr[bi + 1] = M.row_ptr[bi] + counts[bi];
+    }
+    size_t bb = static_cast<size_t>(block) * block;
+    M.col_ind.resize(M.row_ptr[block_rows]);
+    M.values.assign(M.col_ind.size() * bb, Value(0));
+
+    // Блочные столбцы строки упорядочиваются, затем элементы раскладываются по своим блокам
+    unsigned num_threads = host_threads(0);
+    run_threads(num_threads, [&](unsigned t) {
+        std::vector<Index> seen(M.block_cols(), -1);
+        std::vector<Index> slot(M.block_cols());
+        std::vector<Index> row_blocks;
+        Index b0 = static_cast<Index>(static_cast<size_t>(block_rows) * t / num_threads);
+        Index b1 = static_cast<Index>(static_cast<size_t>(block_rows) * (t + 1) / num_threads);
+        for (Index bi = b0; bi < b1; ++bi) {
+            Index row_begin = bi * block;
+            Index row_end = std::min<Index>(A.rows, row_begin + block);
+            row_blocks.clear();
+            for (Index i = row_begin; i < row_end; ++i) {
+                for (Index p = A.row_ptr[i]; p < A.row_ptr[i + 1]; ++p) {
+                    Index bc = A.col_ind[p] / block;
+                    if (seen[bc] != bi) {
+                        seen[bc] = bi;
+                        row_blocks.push_back(bc);
                     }
                 }
-                // sycl::ext::oneapi::experimental::printf("Индекс: sum = %lf\n", sum);
-                if (abs(sum) > eps) {
-                    k ++;
+            }
+            std::sort(row_blocks.begin(), row_blocks.end());
+            for (size_t k = 0; k < row_blocks.size(); ++k) {
+                M.col_ind[M.row_ptr[bi] + k] = row_blocks[k];
+                slot[row_blocks[k]] = M.row_ptr[bi] + static_cast<Index>(k);
+            }
+            for (Index i = row_begin; i < row_end; ++i) {
+                for (Index p = A.row_ptr[i]; p < A.row_ptr[i + 1]; ++p) {
+                    Index c = A.col_ind[p];
+                    size_t pos = static_cast<size_t>(slot[c / block]) * bb + (i - row_begin) * block + c % block;
+                    M.values[pos] = A.values[p];
+                }
+            }
+        }
+    });
+    return M;
+}
+
+template <class Index, class Value>
+BasicCSRMatrix<Index, Value> bsr_to_csr(const BasicBSRMatrix<Index, Value>& A) {
+    int block = A.block;
+    size_t bb = static_cast<size_t>(block) * block;
+    Index block_rows = A.block_rows();
+    BasicCSRMatrix<Index, Value> M(A.rows, A.cols);
+
+    // Элементы строки i: строка i % block всех блоков блочной строки i / block, кроме
+    // столбцов дополнения и нулей
+    auto for_each_element = [&](Index i, auto f) {
+        Index bi = i / block;
+        size_t r = i % block;
+        for (Index p = A.row_ptr[bi]; p < A.row_ptr[bi + 1]; ++p) {
+            Index col_begin = A.col_ind[p] * block;
+            const Value* row = A.values.data() + static_cast<size_t>(p) * bb + r * block;
+            for (int c = 0; c < block && col_begin + c < A.cols; ++c) {
+                if (is_nonzero(row[c])) {
+                    f(col_begin + c, row[c]);
                 }
-                // sycl::ext::oneapi::experimental::printf("Индекс: i = %d    bpos = %d    sum = %lf    k = %d\n", i, bpos, sum, k);
             }
-            acc_row_ptr_C[i] = k;
-            // sycl::ext::oneapi::experimental::printf("Индекс: acc_row_ptr_C[i] = %d\n", acc_row_ptr_C[i]);
-        });
-    }).wait();
+        }
+    };
 
-    for (int k = 1; k < C.row_ptr.size(); k++) {
-        C.row_ptr[k] += C.row_ptr[k - 1];
-        // std::cout << C.row_ptr[k] << std::endl;
+    unsigned num_threads = host_threads(0);
+    auto row_range = [&](unsigned t, Index& r0, Index& r1) {
+        r0 = std::min<Index>(A.rows, static_cast<Index>(static_cast<size_t>(block_rows) * t / num_threads) * block);
+        r1 = std::min<Index>(A.rows, static_cast<Index>(static_cast<size_t>(block_rows) * (t + 1) / num_threads) * block);
+    };
+    run_threads(num_threads, [&](unsigned t) {
+        Index r0, r1;
+        row_range(t, r0, r1);
+        for (Index i = r0; i < r1; ++i) {
+            Index count = 0;
+            for_each_element(i, [&](Index, Value) { ++count; });
+            M.row_ptr[i + 1] = count;
+        }
+    });
+    for (Index i = 0; i < A.rows; ++i) {
+        M.row_ptr[i + 1] += M.row_ptr[i];
     }
+    M.non_zero_el = M.row_ptr[A.rows];
+    M.col_ind.resize(M.non_zero_el);
+    M.values.resize(M.non_zero_el);
+    run_threads(num_threads, [&](unsigned t) {
+        Index r0, r1;
+        row_range(t, r0, r1);
+        for (Index i = r0; i < r1; ++i) {
+            Index pos = M.row_ptr[i];
+            for_each_element(i, [&](Index col, Value v) {
+                M.col_ind[pos] = col;
+                M.values[pos] = v;
+                ++pos;
+            });
+        }
+    });
+    return M;
+}
 
-    C.non_zero_el = C.row_ptr[C.row_ptr.size() - 1];
+template <class Index, class Value>
+MultiplyStats sparse_matrix_multiply(const BasicBSRMatrix<Index, Value>& A, const BasicBSRMatrix<Index, Value>& B,
+                                     BasicBSRMatrix<Index, Value>& C, queue& q) {
+    if (A.cols != B.rows) {
+        throw std::runtime_error("Размеры матриц не совпадают для умножения.");
+    }
+    if (A.block != B.block) {
+        throw std::runtime_error("Размеры блоков BSR-матриц не совпадают.");
+    }
 
-    // std::cout << C.non_zero_el << std::endl;
+    auto start = std::chrono::steady_clock::now();
+    MultiplyStats stats;
+    int block = A.block;
+    size_t bb = static_cast<size_t>(block) * block;
 
-    C.col_ind.resize(C.non_zero_el);
-    C.values.resize(C.non_zero_el);
+    // Блочные структуры A и B как CSR-матрицы без значений; значения блоков копируются отдельно
+    BasicCSRView<Index, Value> A_pattern(A.block_rows(), A.block_cols(), A.blocks(), A.row_ptr.data(),
+                                         A.col_ind.data(), nullptr);
+    BasicCSRView<Index, Value> B_pattern(B.block_rows(), B.block_cols(), B.blocks(), B.row_ptr.data(),
+                                         B.col_ind.data(), nullptr);
+    BasicDeviceCSRMatrix<Index, Value> A_dev(q);
+    BasicDeviceCSRMatrix<Index, Value> B_dev(q);
+    BasicDeviceCSRMatrix<Index, Value> C_dev(q);
+    DeviceArena arena(q);
+    PhaseTimer upload_timer(q);
+    stats.bytes_to_device += upload_matrix(A_pattern, A_dev, q, upload_timer, false);
+    stats.bytes_to_device += upload_matrix(B_pattern, B_dev, q, upload_timer, false);
+    Value* a_val = upload_array(A.values, arena, upload_timer);
+    Value* b_val = upload_array(B.values, arena, upload_timer);
+    stats.bytes_to_device += (A.values.size() + B.values.size()) * sizeof(Value);
+    stats.upload = upload_timer.finish();
 
-    // Создаем временные буферы для хранения индексов и значений ненулевых элементов результирующей матрицы
-    buffer<int, 1> buf_col_ind_C(C.col_ind.data(), range<1>(C.non_zero_el));  // Будем динамически изменять размер
-    buffer<double, 1> buf_values_C(C.values.data(), range<1>(C.non_zero_el));  // Будем динамически изменять размер
-    buffer<int, 1> buf_non_zero_el_C(&C.non_zero_el, range<1>(1));
+    // Блочная структура C: упорядоченные блочные столбцы каждой блочной строки
+    multiply_on_device<OrAnd>(A_dev, B_dev, C_dev, q, SpGEMMBinning(), stats);
+    size_t c_blocks = C_dev.nnz;
+    stats.products *= bb * block;
+    stats.nnz_C = c_blocks * bb;
 
-    // Параллельное умножение разреженных матриц
-    q.submit([&](handler& h) {
-        // Использование аксессоров
-        accessor acc_row_ptr_A = buf_row_ptr_A.get_access<access::mode::read>(h);
-        accessor acc_col_ind_A = buf_col_ind_A.get_access<access::mode::read>(h);
-        accessor acc_values_A = buf_values_A.get_access<access::mode::read>(h);
-        accessor acc_non_zero_el_A = buf_non_zero_el_A.get_access<access::mode::read>(h);
-
-        accessor acc_row_ptr_B = buf_row_ptr_B.get_access<access::mode::read>(h);
-        accessor acc_col_ind_B = buf_col_ind_B.get_access<access::mode::read>(h);
-        accessor acc_values_B = buf_values_B.get_access<access::mode::read>(h);
-        accessor acc_non_zero_el_B = buf_non_zero_el_B.get_access<access::mode::read>(h);
-
-        accessor acc_row_ptr_C = buf_row_ptr_C.get_access<access::mode::read_write>(h);
-        accessor acc_col_ind_C = buf_col_ind_C.get_access<access::mode::write>(h);
-        accessor acc_values_C = buf_values_C.get_access<access::mode::write>(h);
-        accessor acc_non_zero_el_C = buf_non_zero_el_C.get_access<access::mode::read_write>(h);
+    // Рабочий элемент на блочную строку C: позиция блока (i, j) в строке находится двоичным
+    // поиском, строка принадлежит одному рабочему элементу, поэтому атомарные операции не нужны
+    Value* c_val = arena.allocate<Value>(c_blocks * bb);
+    PhaseTimer numeric_timer(q);
+    event cleared = numeric_timer.record(q.fill(c_val, Value(0), c_blocks * bb));
+    size_t block_rows = A_dev.rows;
+    const Index* a_rp = A_dev.row_ptr;
+    const Index* a_ci = A_dev.col_ind;
+    const Index* b_rp = B_dev.row_ptr;
+    const Index* b_ci = B_dev.col_ind;
+    const Index* c_rp = C_dev.row_ptr;
+    const Index* c_ci = C_dev.col_ind;
+    auto numeric = [&](auto size) {
+        constexpr int Bs = decltype(size)::value;
+        numeric_timer.record(q.submit([&](handler& h) {
+            h.depends_on(cleared);
+            h.parallel_for(range<1>(block_rows), [=](id<1> ind) {
+                size_t i = ind[0];
+                for (Index p = a_rp[i]; p < a_rp[i + 1]; ++p) {
+                    const Value* a = a_val + static_cast<size_t>(p) * (Bs * Bs);
+                    Index k = a_ci[p];
+                    for (Index r = b_rp[k]; r < b_rp[k + 1]; ++r) {
+                        Index j = b_ci[r];
+                        Index lo = c_rp[i];
+                        Index hi = c_rp[i + 1];
+                        while (lo < hi) {
+                            Index mid = lo + (hi - lo) / 2;
+                            if (c_ci[mid] < j) {
+                                lo = mid + 1;
+                            } else {
+                                hi = mid;
+                            }
+                        }
+                        block_multiply_add<Bs>(a, b_val + static_cast<size_t>(r) * (Bs * Bs),
+                                               c_val + static_cast<size_t>(lo) * (Bs * Bs));
+                    }
+                }
+            });
+        }));
+    };
+    dispatch_block_size<BSR_BLOCK_SIZES>(block, numeric);
+    stats.numeric += numeric_timer.finish();
 
-        h.parallel_for(range<1>(ro), [=](id<1> ind) {
-            size_t i = ind[0] + 1;
-            int k = 0;
-
-            // sycl::ext::oneapi::experimental::printf("Индекс: %d\n", ind[0] + 1);
-            
-            for (int bpos = 1; bpos < ro2 + 1; ++bpos) {
-                double sum = 0;
-                for (int r = acc_row_ptr_A[i - 1]; r < acc_row_ptr_A[i]; ++r) {
-                    for (int j = acc_row_ptr_B[bpos - 1]; j < acc_row_ptr_B[bpos]; ++j) {
-                        // sycl::ext::oneapi::experimental::printf("Индекс: i = %d    bpos = %d   r = %d   j = %d\n", ind[0] + 1, bpos, r, j);
-                        if (acc_col_ind_B[j] == acc_col_ind_A[r]) {
-                            sum += acc_values_A[r] * acc_values_B[j];
-                            break;
+    BasicCSRMatrix<Index, Value> C_pattern;
+    download_matrix(C_dev, C_pattern, q, stats, false);
+    BasicBSRMatrix<Index, Value> result(A.rows, B.cols, block);
+    result.row_ptr = std::move(C_pattern.row_ptr);
+    result.col_ind = std::move(C_pattern.col_ind);
+    result.values.resize(c_blocks * bb);
+    PhaseTimer download_timer(q);
+    if (c_blocks > 0) {
+        download_timer.record(q.memcpy(result.values.data(), c_val, c_blocks * bb * sizeof(Value)));
+    }
+    stats.download += download_timer.finish();
+    stats.bytes_from_device += c_blocks * bb * sizeof(Value);
+    C = std::move(result);
+
+    stats.total = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    dump_stats_json(stats);
+    return stats;
+}
+
+template <class Index, class Value>
+void sparse_matrix_vector_multiply(const BasicBSRMatrix<Index, Value>& A, const std::vector<Value>& x,
+                                   std::vector<Value>& y, queue& q) {
+    if (x.size() != static_cast<size_t>(A.cols)) {
+        throw std::runtime_error("Длина вектора не совпадает с числом столбцов матрицы.");
+    }
+
+    // x и y дополняются нулями до кратных размеру блока, поэтому в ядре нет проверок границ
+    size_t block_rows = A.block_rows();
+    size_t x_size = static_cast<size_t>(A.block_cols()) * A.block;
+    size_t y_size = block_rows * A.block;
+    DeviceArena arena(q);
+    PhaseTimer timer(q);
+    Index* rp = upload_array(A.row_ptr, arena, timer);
+    Index* ci = upload_array(A.col_ind, arena, timer);
+    Value* val = upload_array(A.values, arena, timer);
+    Value* x_dev = arena.allocate<Value>(x_size);
+    Value* y_dev = arena.allocate<Value>(y_size);
+    event cleared = q.fill(x_dev, Value(0), x_size);
+    timer.record(q.submit([&](handler& h) {
+        h.depends_on(cleared);
+        h.memcpy(x_dev, x.data(), x.size() * sizeof(Value));
+    }));
+    timer.finish();
+
+    // Рабочий элемент на блочную строку: блок x загружается один раз на Bs строк блока
+    auto spmv = [&](auto size) {
+        constexpr int Bs = decltype(size)::value;
+        q.submit([&](handler& h) {
+            h.parallel_for(range<1>(block_rows), [=](id<1> ind) {
+                size_t i = ind[0];
+                Value acc[Bs] = {};
+                for (Index p = rp[i]; p < rp[i + 1]; ++p) {
+                    const Value* a = val + static_cast<size_t>(p) * (Bs * Bs);
+                    const Value* xb = x_dev + static_cast<size_t>(ci[p]) * Bs;
+                    for (int r = 0; r < Bs; ++r) {
+                        for (int c = 0; c < Bs; ++c) {
+                            acc[r] += a[r * Bs + c] * xb[c];
                         }
                     }
                 }
-                if (abs(sum) > eps) {
-                    // sycl::ext::oneapi::experimental::printf("Индекс: i - 1 = %d    bpos - 1 = %d   sum = %lf    k = %d\n", i - 1, bpos - 1, sum, k);
-                    acc_col_ind_C[acc_row_ptr_C[i - 1] + k] = bpos - 1;
-                    acc_values_C[acc_row_ptr_C[i - 1] + k] = sum;
-                    k ++;
+                for (int r = 0; r < Bs; ++r) {
+                    y_dev[i * Bs + r] = acc[r];
+                }
+            });
+        }).wait();
+    };
+    dispatch_block_size<BSR_BLOCK_SIZES>(A.block, spmv);
+
+    y.resize(A.rows);
+    q.memcpy(y.data(), y_dev, y.size() * sizeof(Value)).wait();
+}
+
+// Точное число произведений в A * B
+template <class Index, class Value>
+static size_t product_flops(const BasicCSRView<Index, Value>& A, const BasicCSRView<Index, Value>& B) {
+    size_t flops = 0;
+    for (size_t p = 0; p < A.nnz; ++p) {
+        Index col = A.col_ind[p];
+        flops += B.row_ptr[col + 1] - B.row_ptr[col];
+    }
+    return flops;
+}
+
+template <class Index, class Value>
+size_t estimate_product_nnz(const BasicCSRView<Index, Value>& A, const BasicCSRView<Index, Value>& B,
+                            NnzEstimator estimator, size_t samples, unsigned seed) {
+    if (A.cols != B.rows) {
+        throw std::runtime_error("Размеры матриц не совпадают для умножения.");
+    }
+
+    size_t total_flops = 0;
+    size_t upper_bound = 0;
+    for (Index i = 0; i < A.rows; ++i) {
+        size_t flops = row_flops(A, B, i);
+        total_flops += flops;
+        upper_bound += std::min<size_t>(flops, B.cols);
+    }
+    if (estimator == NnzEstimator::upper_bound || total_flops == 0) {
+        return upper_bound;
+    }
+
+    // Строки выборки накапливаются точно: marker[j] - номер последней строки со столбцом j.
+    // При samples >= A.rows выборка - все строки, и результат точный.
+    bool exact = static_cast<size_t>(A.rows) <= samples;
+    size_t n = exact ? A.rows : samples;
+    std::mt19937 gen(seed);
+    std::uniform_int_distribution<Index> random_row(0, A.rows - 1);
+    std::vector<size_t> marker(B.cols, std::numeric_limits<size_t>::max());
+    size_t sample_flops = 0;
+    size_t sample_nnz = 0;
+    for (size_t s = 0; s < n; ++s) {
+        Index i = exact ? static_cast<Index>(s) : random_row(gen);
+        for (Index p = A.row_ptr[i]; p < A.row_ptr[i + 1]; ++p) {
+            Index k = A.col_ind[p];
+            sample_flops += B.row_ptr[k + 1] - B.row_ptr[k];
+            for (Index r = B.row_ptr[k]; r < B.row_ptr[k + 1]; ++r) {
+                if (marker[B.col_ind[r]] != s) {
+                    marker[B.col_ind[r]] = s;
+                    ++sample_nnz;
                 }
             }
-        });
-    }).wait();
+        }
+    }
+    if (exact) {
+        return sample_nnz;
+    }
+    // Сжатие (flops / nnz) выборки переносится на всю матрицу; строки без произведений
+    // в выборке не дают оценки сжатия
+    double ratio = sample_flops > 0 ? static_cast<double>(sample_nnz) / sample_flops : 1.0;
+    return std::min(upper_bound, static_cast<size_t>(std::llround(ratio * total_flops)));
 }
 
-// Функция для чтения матрицы в формате CSR из файла
-CSRMatrix read_matrix_from_file(const std::string& filename) {
-    CSRMatrix matrix;
-    int non_zero_elements;
-    std::ifstream file(filename);
+// Расстановка скобок в цепочке динамическим программированием по отрезкам factors[i..j]:
+// split[i * n + j] - последний сомножитель левой части лучшего разбиения. Стоимость
+// произведения - flops, nnz и число строк результата (разбиение на корзины, сканирования
+// и аккумуляторы пропорциональны числу строк). Для пар исходных матриц flops считаются точно,
+// а nnz оценивается выборкой; для промежуточных произведений с nnz L и R и внутренней
+// размерностью k flops оцениваются как L * R / k (равномерное распределение), а nnz -
+// как заполнение m * n ячеек flops случайными попаданиями: m * n * (1 - exp(-flops / (m * n))).
+template <class Index, class Value>
+static std::vector<size_t> chain_splits(const std::vector<BasicCSRView<Index, Value>>& factors) {
+    size_t n = factors.size();
+    if (n == 0) {
+        throw std::runtime_error("Цепочка умножений не содержит матриц.");
+    }
+    for (size_t i = 0; i + 1 < n; ++i) {
+        if (factors[i].cols != factors[i + 1].rows) {
+            throw std::runtime_error("Размеры матриц не совпадают для умножения.");
+        }
+    }
 
-    if (!file.is_open()) {
-        throw std::runtime_error("Не удалось открыть файл: " + filename);
+    std::vector<double> nnz(n * n, 0), cost(n * n, 0);
+    std::vector<size_t> split(n * n, 0);
+    for (size_t i = 0; i < n; ++i) {
+        nnz[i * n + i] = static_cast<double>(factors[i].nnz);
+    }
+    for (size_t len = 2; len <= n; ++len) {
+        for (size_t i = 0; i + len <= n; ++i) {
+            size_t j = i + len - 1;
+            cost[i * n + j] = std::numeric_limits<double>::infinity();
+            for (size_t k = i; k < j; ++k) {
+                double flops, out;
+                if (len == 2) {
+                    flops = static_cast<double>(product_flops(factors[i], factors[j]));
+                    out = static_cast<double>(estimate_product_nnz(factors[i], factors[j]));
+                } else {
+                    double inner = factors[k].cols;
+                    flops = inner > 0 ? nnz[i * n + k] * nnz[(k + 1) * n + j] / inner : 0;
+                    double cells = static_cast<double>(factors[i].rows) * factors[j].cols;
+                    out = cells > 0 ? cells * (1 - std::exp(-flops / cells)) : 0;
+                }
+                double c = cost[i * n + k] + cost[(k + 1) * n + j] + flops + out + factors[i].rows;
+                if (c < cost[i * n + j]) {
+                    cost[i * n + j] = c;
+                    nnz[i * n + j] = out;
+                    split[i * n + j] = k;
+                }
+            }
+        }
     }
+    return split;
+}
 
-    // Считываем количество строк и столбцов
-    file >> matrix.rows >> non_zero_elements;
-    matrix.cols = matrix.rows;
-    matrix.non_zero_el = non_zero_elements;
+static std::string chain_order_string(const std::vector<size_t>& split, size_t n, size_t i, size_t j) {
+    if (i == j) {
+        return "A" + std::to_string(i);
+    }
+    size_t k = split[i * n + j];
+    return "(" + chain_order_string(split, n, i, k) + " * " + chain_order_string(split, n, k + 1, j) + ")";
+}
 
-    // Считываем массив row_ptr
-    matrix.row_ptr.resize(matrix.rows + 1);
-    for (int i = 0; i <= matrix.rows; ++i) {
-        file >> matrix.row_ptr[i];
+template <class Index, class Value>
+std::string chain_multiply_order(const std::vector<BasicCSRView<Index, Value>>& factors) {
+    return chain_order_string(chain_splits(factors), factors.size(), 0, factors.size() - 1);
+}
+
+template <class Index, class Value>
+MultiplyStats sparse_matrix_chain_multiply(const std::vector<BasicCSRView<Index, Value>>& factors,
+                                           BasicCSRMatrix<Index, Value>& C, queue& q, const SpGEMMBinning& binning) {
+    auto start = std::chrono::steady_clock::now();
+    MultiplyStats stats;
+    std::vector<size_t> split = chain_splits(factors);
+    size_t n = factors.size();
+
+    // Сомножители на устройстве; матрица, повторяющаяся в цепочке, копируется один раз
+    using DeviceMatrix = BasicDeviceCSRMatrix<Index, Value>;
+    std::vector<std::shared_ptr<DeviceMatrix>> leaves(n);
+    PhaseTimer upload_timer(q);
+    for (size_t i = 0; i < n; ++i) {
+        const BasicCSRView<Index, Value>& M = factors[i];
+        for (size_t j = 0; j < i; ++j) {
+            const BasicCSRView<Index, Value>& P = factors[j];
+            if (P.row_ptr == M.row_ptr && P.col_ind == M.col_ind && P.values == M.values && P.rows == M.rows) {
+                leaves[i] = leaves[j];
+                break;
+            }
+        }
+        if (!leaves[i]) {
+            leaves[i] = std::make_shared<DeviceMatrix>(q);
+            stats.bytes_to_device += upload_matrix(M, *leaves[i], q, upload_timer);
+        }
     }
+    stats.upload = upload_timer.finish();
 
-    // Считываем массив col_ind
-    matrix.col_ind.resize(non_zero_elements);
-    for (int i = 0; i < non_zero_elements; ++i) {
-        file >> matrix.col_ind[i];
+    // Обход дерева разбиений. Сомножитель или промежуточное произведение, на которое не
+    // осталось ссылок, возвращается в пул и становится буфером следующего произведения:
+    // память матриц только растет, поэтому цепочка слева направо чередует два буфера
+    SpGEMMScratch<Index, Value> scratch(q);
+    std::vector<std::shared_ptr<DeviceMatrix>> spare;
+    auto recycle = [&](std::shared_ptr<DeviceMatrix>& M) {
+        if (M.use_count() == 1) {
+            spare.push_back(std::move(M));
+        }
+        M.reset();
+    };
+    std::function<std::shared_ptr<DeviceMatrix>(size_t, size_t)> evaluate = [&](size_t i, size_t j) {
+        if (i == j) {
+            return std::move(leaves[i]);
+        }
+        size_t k = split[i * n + j];
+        std::shared_ptr<DeviceMatrix> left = evaluate(i, k);
+        std::shared_ptr<DeviceMatrix> right = evaluate(k + 1, j);
+        std::shared_ptr<DeviceMatrix> product;
+        if (spare.empty()) {
+            product = std::make_shared<DeviceMatrix>(q);
+        } else {
+            product = std::move(spare.back());
+            spare.pop_back();
+        }
+        multiply_on_device(*left, *right, *product, q, binning, stats, &scratch);
+        recycle(left);
+        recycle(right);
+        return product;
+    };
+    std::shared_ptr<DeviceMatrix> result = evaluate(0, n - 1);
+
+    download_matrix(*result, C, q, stats);
+    stats.nnz_C = C.col_ind.size();
+    stats.total = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    dump_stats_json(stats);
+    return stats;
+}
+
+template <class Index, class Value>
+MultiplyStats sparse_matrix_power(const non_deduced_t<BasicCSRView<Index, Value>>& A, unsigned k,
+                                  BasicCSRMatrix<Index, Value>& C, queue& q, const SpGEMMBinning& binning) {
+    if (A.rows != A.cols) {
+        throw std::runtime_error("Степень определена только для квадратной матрицы.");
     }
 
-    // Считываем массив values
-    matrix.values.resize(non_zero_elements);
-    for (int i = 0; i < non_zero_elements; ++i) {
-        file >> matrix.values[i];
+    auto start = std::chrono::steady_clock::now();
+    MultiplyStats stats;
+    if (k == 0) {
+        BasicCSRMatrix<Index, Value> identity(A.rows, A.cols);
+        for (Index i = 0; i < A.rows; ++i) {
+            identity.row_ptr[i + 1] = i + 1;
+            identity.col_ind.push_back(i);
+            identity.values.push_back(Value(1));
+        }
+        identity.non_zero_el = A.rows;
+        C = std::move(identity);
+        stats.nnz_C = C.col_ind.size();
+        stats.total = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return stats;
     }
 
-    file.close();
+    BasicDeviceCSRMatrix<Index, Value> base(q);
+    PhaseTimer upload_timer(q);
+    stats.bytes_to_device += upload_matrix(A, base, q, upload_timer);
+    stats.upload = upload_timer.finish();
+
+    // current - A^(старшие биты k); product - буфер следующего результата, после умножения
+    // он меняется местами с owned, и прежняя степень становится буфером следующего шага
+    int top = 0;
+    while ((k >> (top + 1)) != 0) {
+        ++top;
+    }
+    SpGEMMScratch<Index, Value> scratch(q);
+    BasicDeviceCSRMatrix<Index, Value> owned(q);
+    BasicDeviceCSRMatrix<Index, Value> product(q);
+    const BasicDeviceCSRMatrix<Index, Value>* current = &base;
+    for (int b = top - 1; b >= 0; --b) {
+        multiply_on_device(*current, *current, product, q, binning, stats, &scratch);
+        std::swap(owned, product);
+        current = &owned;
+        if ((k >> b) & 1u) {
+            multiply_on_device(*current, base, product, q, binning, stats, &scratch);
+            std::swap(owned, product);
+        }
+    }
+
+    download_matrix(*current, C, q, stats);
+    stats.nnz_C = C.col_ind.size();
+    stats.total = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    dump_stats_json(stats);
+    return stats;
+}
+
+DeviceArena::DeviceArena(queue& q, size_t initial_bytes, double growth) : q(q), growth(std::max(1.0, growth)) {
+    if (initial_bytes > 0) {
+        add_chunk(initial_bytes);
+    }
+}
+
+DeviceArena::~DeviceArena() {
+    for (auto& chunk : chunks) {
+        sycl::free(chunk.data, q);
+    }
+}
+
+void DeviceArena::add_chunk(size_t bytes) {
+    char* data = malloc_device<char>(bytes, q);
+    if (data == nullptr) {
+        throw std::runtime_error("Не удалось выделить память на устройстве.");
+    }
+    chunks.push_back({data, bytes});
+    offset = 0;
+    ++allocations;
+}
+
+size_t DeviceArena::reserved_bytes() const {
+    size_t bytes = 0;
+    for (const auto& chunk : chunks) {
+        bytes += chunk.size;
+    }
+    return bytes;
+}
+
+void* DeviceArena::allocate_bytes(size_t bytes, size_t alignment) {
+    auto aligned_start = [&]() {
+        uintptr_t base = reinterpret_cast<uintptr_t>(chunks.back().data);
+        return ((base + offset + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1)) - base;
+    };
+    size_t start = chunks.empty() ? 0 : aligned_start();
+    if (chunks.empty() || start + bytes > chunks.back().size) {
+        // Новый блок не меньше уже зарезервированной памяти: число блоков до сброса растет
+        // логарифмически от требуемого объема
+        add_chunk(std::max(bytes + alignment, reserved_bytes()));
+        start = aligned_start();
+    }
+    used += start - offset + bytes;
+    offset = start + bytes;
+    peak = std::max(peak, used);
+    return chunks.back().data + start;
+}
+
+void DeviceArena::reset() {
+    if (chunks.size() > 1) {
+        size_t bytes = static_cast<size_t>(static_cast<double>(peak) * growth);
+        for (auto& chunk : chunks) {
+            sycl::free(chunk.data, q);
+        }
+        chunks.clear();
+        add_chunk(std::max<size_t>(bytes, 1));
+    }
+    offset = 0;
+    used = 0;
+    peak = 0;
+}
+
+// Запись сжатой строки row длины n (keys/sums) в место, зарезервированное в slab по оценке,
+// если она там помещается; иначе строка остается в аккумуляторе. Длина записывается в c_len.
+template <class Semiring, class Index, class Value>
+inline bool store_estimated_row(size_t lane, size_t lanes, size_t row, size_t n, const Index* keys, const Value* sums,
+                                const size_t* c_offset, Index* slab_ci, Value* slab_val, Index* c_len) {
+    size_t begin = c_offset[row];
+    bool fits = n <= c_offset[row + 1] - begin;
+    if (fits) {
+        for (size_t e = lane; e < n; e += lanes) {
+            slab_ci[begin + e] = keys[e];
+            if constexpr (Semiring::has_values) {
+                slab_val[begin + e] = sums[e];
+            }
+        }
+    }
+    if (lane == 0) {
+        c_len[row] = static_cast<Index>(n);
+    }
+    return fits;
+}
+
+template <class Semiring, class Index, class Value>
+MultiplyStats sparse_matrix_multiply_single_pass(const non_deduced_t<BasicCSRView<Index, Value>>& A,
+                                                 const non_deduced_t<BasicCSRView<Index, Value>>& B,
+                                                 BasicCSRMatrix<Index, Value>& C, DeviceArena& arena,
+                                                 const SinglePassOptions& options, const SpGEMMBinning& binning) {
+    if (A.cols != B.rows) {
+        throw std::runtime_error("Размеры матриц не совпадают для умножения.");
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    MultiplyStats stats;
+    queue& q = arena.get_queue();
+    arena.reset();
+    stats.device_timing = q.has_property<property::queue::enable_profiling>();
+    Index ro = A.rows;
+    Index cols = B.cols;
+    constexpr bool has_values = Semiring::has_values;
+
+    // Место под C передается вызывающему без перевыделения, если емкости векторов хватает
+    auto resize_result = [&](size_t nnz) {
+        C.invalidate_transposed();
+        C.rows = ro;
+        C.cols = cols;
+        C.non_zero_el = static_cast<Index>(nnz);
+        C.row_ptr.resize(ro + 1);
+        C.col_ind.resize(nnz);
+        C.values.resize(nnz);
+    };
+    // Без произведений (в том числе когда столбцы A попадают только в пустые строки B) C пуста
+    size_t flops = ro == 0 || A.nnz == 0 || B.nnz == 0 ? 0 : product_flops(A, B);
+    if (flops == 0) {
+        resize_result(0);
+        std::fill(C.row_ptr.begin(), C.row_ptr.end(), Index(0));
+        stats.total = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return stats;
+    }
+
+    // Сжатие nnz / flops по выборке строк на хосте
+    float scale = 1.0f;
+    bool upper_bound = options.estimator == NnzEstimator::upper_bound;
+    if (!upper_bound) {
+        double ratio = static_cast<double>(estimate_product_nnz(A, B, NnzEstimator::sampled, options.samples)) / flops;
+        scale = static_cast<float>(ratio * std::max(options.slack, 1.0));
+    }
+
+    PhaseTimer upload_timer(q);
+    auto upload = [&](const BasicCSRView<Index, Value>& M, Index*& rp, Index*& ci, Value*& val) {
+        rp = arena.allocate<Index>(M.rows + 1);
+        ci = arena.allocate<Index>(M.nnz);
+        val = has_values ? arena.allocate<Value>(M.nnz) : nullptr;
+        upload_timer.record(q.memcpy(rp, M.row_ptr, (M.rows + 1) * sizeof(Index)));
+        upload_timer.record(q.memcpy(ci, M.col_ind, M.nnz * sizeof(Index)));
+        if constexpr (has_values) {
+            upload_timer.record(q.memcpy(val, M.values, M.nnz * sizeof(Value)));
+        }
+        stats.bytes_to_device += (M.rows + 1) * sizeof(Index) + M.nnz * (sizeof(Index) + (has_values ? sizeof(Value) : 0));
+    };
+    Index *a_rp, *a_ci, *b_rp, *b_ci;
+    Value *a_val, *b_val;
+    upload(A, a_rp, a_ci, a_val);
+    upload(B, b_rp, b_ci, b_val);
+    stats.upload = upload_timer.finish();
+
+    size_t wg = std::min<size_t>(256, q.get_device().get_info<info::device::max_work_group_size>());
+
+    // Корзины, раскладка аккумуляторов и оценка длины строк: c_offset[i] после префиксной
+    // суммы - начало места строки i в slab. bin_info[9] - счетчик переполнений.
+    size_t* acc_offset = arena.allocate<size_t>(ro + 1);
+    size_t* c_offset = arena.allocate<size_t>(ro + 1);
+    Index* bin_rows = arena.allocate<Index>(3 * static_cast<size_t>(ro));
+    size_t* bin_info = arena.allocate<size_t>(10);
+
+    PhaseTimer binning_timer(q);
+    binning_timer.record(q.fill(bin_info, size_t(0), 10)).wait();
+    binning_timer.record(bin_rows_by_flops(a_rp, a_ci, b_rp, ro, cols, binning, acc_offset, bin_rows, bin_info, wg, q,
+                                           [=](size_t i, size_t flops) {
+        size_t bound = sycl::min(flops, static_cast<size_t>(cols));
+        size_t estimate = upper_bound ? bound : static_cast<size_t>(flops * scale) + 1;
+        c_offset[i] = sycl::min(bound, estimate);
+    }));
+    stats.binning += binning_timer.finish();
+
+    PhaseTimer scan_timer(q);
+    exclusive_scan_device(acc_offset, ro + 1, arena.allocate<size_t>(scan_temp_size(ro + 1, q)), q, scan_timer.sink());
+    exclusive_scan_device(c_offset, ro + 1, arena.allocate<size_t>(scan_temp_size(ro + 1, q)), q, scan_timer.sink());
+    stats.scan += scan_timer.finish();
+
+    size_t info[9];
+    size_t scratch_size = 0;
+    size_t slab_size = 0;
+    PhaseTimer transfer_timer(q);
+    transfer_timer.record(q.memcpy(info, bin_info, sizeof(info)));
+    transfer_timer.record(q.memcpy(&scratch_size, acc_offset + ro, sizeof(size_t)));
+    transfer_timer.record(q.memcpy(&slab_size, c_offset + ro, sizeof(size_t)));
+    stats.transfer += transfer_timer.finish();
+    stats.bytes_from_device += sizeof(info) + 2 * sizeof(size_t);
+    for (int b = 0; b < 3; ++b) {
+        stats.bins.rows[b] += info[b];
+        stats.bins.flops[b] += info[3 + b];
+        stats.bins.max_flops[b] = std::max<size_t>(stats.bins.max_flops[b], info[6 + b]);
+        stats.products += info[3 + b];
+    }
+
+    Index* keys = arena.allocate<Index>(scratch_size);
+    Value* sums = has_values ? arena.allocate<Value>(scratch_size) : nullptr;
+    Index* slab_ci = arena.allocate<Index>(slab_size);
+    Value* slab_val = has_values ? arena.allocate<Value>(slab_size) : nullptr;
+    Index* c_rp = arena.allocate<Index>(ro + 1);
+    size_t* overflow = bin_info + 9;
+
+    size_t n_tiny = info[0];
+    size_t n_medium = info[1];
+    size_t n_heavy = info[2];
+    const Index* tiny_rows = bin_rows;
+    const Index* medium_rows = bin_rows + ro;
+    const Index* heavy_rows = bin_rows + 2 * static_cast<size_t>(ro);
+    size_t local_capacity = local_accumulator_capacity(q.get_device(), sizeof(Index) + (has_values ? sizeof(Value) : 0));
+
+    // Однопроходное ядро: накопление, сжатие и запись строки в место по оценке
+    PhaseTimer numeric_timer(q);
+    event cleared = numeric_timer.record(q.fill(c_rp, Index(0), ro + 1));
+    if (n_tiny > 0) {
+        numeric_timer.record(q.submit([&](handler& h) {
+            h.depends_on(cleared);
+            h.parallel_for(range<1>(n_tiny), [=](id<1> ind) {
+                size_t i = tiny_rows[ind[0]];
+                size_t off = acc_offset[i];
+                size_t size = acc_offset[i + 1] - off;
+                gustavson_accumulate<Semiring>(i, a_rp, a_ci, a_val, b_rp, b_ci, b_val, keys, sums, off, size, cols);
+                size_t n = gustavson_compact<Semiring>(keys, sums, off, size, cols);
+                if (!store_estimated_row<Semiring>(0, 1, i, n, keys + off, has_values ? sums + off : nullptr,
+                                                   c_offset, slab_ci, slab_val, c_rp)) {
+                    shared_atomic<size_t>(*overflow).fetch_add(1);
+                }
+            });
+        }));
+    }
+    if (n_medium > 0) {
+        size_t groups = std::min<size_t>((n_medium * 16 + wg - 1) / wg, 65536);
+        numeric_timer.record(q.submit([&](handler& h) {
+            h.depends_on(cleared);
+            h.parallel_for(nd_range<1>(range<1>(groups * wg), range<1>(wg)), [=](nd_item<1> it) {
+                auto sg = it.get_sub_group();
+                size_t lane = sg.get_local_linear_id();
+                size_t lanes = sg.get_local_linear_range();
+                size_t per_group = sg.get_group_range()[0];
+                size_t first = it.get_group(0) * per_group + sg.get_group_linear_id();
+                size_t stride = it.get_group_range(0) * per_group;
+
+                for (size_t r = first; r < n_medium; r += stride) {
+                    size_t i = medium_rows[r];
+                    size_t off = acc_offset[i];
+                    size_t size = acc_offset[i + 1] - off;
+                    Value* row_sums = has_values ? sums + off : nullptr;
+                    group_accumulate_row<Semiring>(sg, lane, lanes, i, a_rp, a_ci, a_val, b_rp, b_ci, b_val,
+                                                   keys + off, row_sums, size, cols);
+                    size_t n = group_compact_row<Semiring>(sg, lane, lanes, keys + off, row_sums, size, cols);
+                    bool fits = store_estimated_row<Semiring>(lane, lanes, i, n, keys + off, row_sums, c_offset,
+                                                              slab_ci, slab_val, c_rp);
+                    if (!fits && lane == 0) {
+                        shared_atomic<size_t>(*overflow).fetch_add(1);
+                    }
+                }
+            });
+        }));
+    }
+    if (n_heavy > 0) {
+        numeric_timer.record(q.submit([&](handler& h) {
+            h.depends_on(cleared);
+            local_accessor<Index, 1> local_keys(range<1>(local_capacity), h);
+            local_accessor<Value, 1> local_sums(range<1>(has_values ? local_capacity : 1), h);
+
+            h.parallel_for(nd_range<1>(range<1>(n_heavy * wg), range<1>(wg)), [=](nd_item<1> it) {
+                auto g = it.get_group();
+                size_t lane = it.get_local_id(0);
+                size_t i = heavy_rows[it.get_group(0)];
+                size_t off = acc_offset[i];
+                size_t size = acc_offset[i + 1] - off;
+
+                bool in_local = size <= local_capacity;
+                Index* row_keys = in_local ? &local_keys[0] : keys + off;
+                Value* row_sums = !has_values ? nullptr : (in_local ? &local_sums[0] : sums + off);
+                group_accumulate_row<Semiring>(g, lane, wg, i, a_rp, a_ci, a_val, b_rp, b_ci, b_val, row_keys,
+                                               row_sums, size, cols);
+                size_t n = group_compact_row<Semiring>(g, lane, wg, row_keys, row_sums, size, cols);
+                bool fits = store_estimated_row<Semiring>(lane, wg, i, n, row_keys, row_sums, c_offset, slab_ci,
+                                                          slab_val, c_rp);
+
+                // Строка сверх оценки переносится в C из аккумулятора, поэтому сохраняется в глобальном
+                if (!fits) {
+                    if (lane == 0) {
+                        shared_atomic<size_t>(*overflow).fetch_add(1);
+                    }
+                    if (in_local) {
+                        for (size_t e = lane; e < n; e += wg) {
+                            keys[off + e] = row_keys[e];
+                            if constexpr (has_values) {
+                                sums[off + e] = row_sums[e];
+                            }
+                        }
+                    }
+                }
+            });
+        }));
+    }
+    stats.numeric += numeric_timer.finish();
+
+    scan_timer = PhaseTimer(q);
+    exclusive_scan_device(c_rp, ro + 1, arena.allocate<Index>(scan_temp_size(ro + 1, q)), q, scan_timer.sink());
+    stats.scan += scan_timer.finish();
+
+    Index nnz_C = 0;
+    transfer_timer = PhaseTimer(q);
+    transfer_timer.record(q.memcpy(&nnz_C, c_rp + ro, sizeof(Index)));
+    transfer_timer.record(q.memcpy(&stats.overflow_rows, overflow, sizeof(size_t)));
+    stats.transfer += transfer_timer.finish();
+    stats.bytes_from_device += sizeof(Index) + sizeof(size_t);
+    stats.nnz_C = nnz_C;
+
+    // Сжатие C: строки переносятся из slab (или из аккумулятора при переполнении) подряд.
+    // Если все строки заняли ровно свои места, slab уже является C.
+    Index* c_ci = slab_ci;
+    Value* c_val = slab_val;
+    if (stats.overflow_rows > 0 || static_cast<size_t>(nnz_C) != slab_size) {
+        c_ci = arena.allocate<Index>(nnz_C);
+        c_val = has_values ? arena.allocate<Value>(nnz_C) : nullptr;
+        numeric_timer = PhaseTimer(q);
+        numeric_timer.record(q.submit([&](handler& h) {
+            h.parallel_for(range<1>(ro), [=](id<1> ind) {
+                size_t i = ind[0];
+                size_t begin = c_rp[i];
+                size_t n = c_rp[i + 1] - begin;
+                bool fits = n <= c_offset[i + 1] - c_offset[i];
+                const Index* src_ci = fits ? slab_ci + c_offset[i] : keys + acc_offset[i];
+                for (size_t e = 0; e < n; ++e) {
+                    c_ci[begin + e] = src_ci[e];
+                }
+                if constexpr (has_values) {
+                    const Value* src_val = fits ? slab_val + c_offset[i] : sums + acc_offset[i];
+                    for (size_t e = 0; e < n; ++e) {
+                        c_val[begin + e] = src_val[e];
+                    }
+                }
+            });
+        }));
+        stats.numeric += numeric_timer.finish();
+    }
+    stats.peak_scratch_bytes = arena.peak_bytes();
+
+    resize_result(nnz_C);
+    PhaseTimer download_timer(q);
+    download_timer.record(q.memcpy(C.row_ptr.data(), c_rp, (ro + 1) * sizeof(Index)));
+    if (nnz_C > 0) {
+        download_timer.record(q.memcpy(C.col_ind.data(), c_ci, nnz_C * sizeof(Index)));
+        if constexpr (has_values) {
+            download_timer.record(q.memcpy(C.values.data(), c_val, nnz_C * sizeof(Value)));
+        }
+    }
+    if constexpr (!has_values) {
+        std::fill(C.values.begin(), C.values.end(), Value(1));
+    }
+    stats.download += download_timer.finish();
+    stats.bytes_from_device += (ro + 1) * sizeof(Index) + nnz_C * (sizeof(Index) + (has_values ? sizeof(Value) : 0));
+
+    stats.total = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    dump_stats_json(stats);
+    return stats;
+}
+
+// Сборка CSR из списка (строка, столбец): сортировка, удаление повторов, случайные значения
+static CSRMatrix matrix_from_coordinates(int rows, int cols, std::vector<std::pair<int, int>>& coords, std::mt19937& gen) {
+    std::sort(coords.begin(), coords.end());
+    coords.erase(std::unique(coords.begin(), coords.end()), coords.end());
+
+    std::uniform_real_distribution<double> value(0.5, 1.5);
+    CSRMatrix matrix(rows, cols);
+    matrix.col_ind.reserve(coords.size());
+    matrix.values.reserve(coords.size());
+    for (const auto& [i, j] : coords) {
+        matrix.row_ptr[i + 1]++;
+        matrix.col_ind.push_back(j);
+        matrix.values.push_back(value(gen));
+    }
+    for (int i = 0; i < rows; ++i) {
+        matrix.row_ptr[i + 1] += matrix.row_ptr[i];
+    }
+    matrix.non_zero_el = static_cast<int>(coords.size());
     return matrix;
 }
 
+CSRMatrix generate_uniform_random(int rows, int cols, double density, unsigned seed) {
+    std::mt19937 gen(seed);
+    long long target = static_cast<long long>(density * rows * cols);
+    std::uniform_int_distribution<int> row(0, rows - 1), col(0, cols - 1);
+
+    std::vector<std::pair<int, int>> coords;
+    coords.reserve(target);
+    for (long long k = 0; k < target; ++k) {
+        coords.emplace_back(row(gen), col(gen));
+    }
+    return matrix_from_coordinates(rows, cols, coords, gen);
+}
+
+CSRMatrix generate_banded(int n, int half_bandwidth, unsigned seed) {
+    std::mt19937 gen(seed);
+    std::vector<std::pair<int, int>> coords;
+    coords.reserve(static_cast<size_t>(n) * (2 * half_bandwidth + 1));
+    for (int i = 0; i < n; ++i) {
+        for (int j = std::max(0, i - half_bandwidth); j <= std::min(n - 1, i + half_bandwidth); ++j) {
+            coords.emplace_back(i, j);
+        }
+    }
+    return matrix_from_coordinates(n, n, coords, gen);
+}
+
+CSRMatrix generate_block_banded(int n_nodes, int half_bandwidth, int block, unsigned seed) {
+    std::mt19937 gen(seed);
+    std::vector<std::pair<int, int>> coords;
+    coords.reserve(static_cast<size_t>(n_nodes) * (2 * half_bandwidth + 1) * block * block);
+    for (int i = 0; i < n_nodes; ++i) {
+        for (int j = std::max(0, i - half_bandwidth); j <= std::min(n_nodes - 1, i + half_bandwidth); ++j) {
+            for (int r = 0; r < block; ++r) {
+                for (int c = 0; c < block; ++c) {
+                    coords.emplace_back(i * block + r, j * block + c);
+                }
+            }
+        }
+    }
+    return matrix_from_coordinates(n_nodes * block, n_nodes * block, coords, gen);
+}
+
+CSRMatrix generate_rmat(int scale, int edge_factor, double a, double b, double c, unsigned seed) {
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution<double> u(0.0, 1.0);
+    int n = 1 << scale;
+    long long edges = static_cast<long long>(edge_factor) * n;
+
+    std::vector<std::pair<int, int>> coords;
+    coords.reserve(edges);
+    for (long long e = 0; e < edges; ++e) {
+        int i = 0, j = 0;
+        for (int level = 0; level < scale; ++level) {
+            double r = u(gen);
+            int bit = 1 << (scale - level - 1);
+            if (r < a) {
+            } else if (r < a + b) {
+                j |= bit;
+            } else if (r < a + b + c) {
+                i |= bit;
+            } else {
+                i |= bit;
+                j |= bit;
+            }
+        }
+        coords.emplace_back(i, j);
+    }
+    return matrix_from_coordinates(n, n, coords, gen);
+}
+
 void Available_platforms()
 {
     // Получаем платформы
@@ -193,4 +4433,107 @@ void Available_platforms()
     }
 
     std::cout << "\n" << std::endl;
-}
\ No newline at end of file
+}
+
+// Явные инстанцирования шаблонов для {int32_t, int64_t} x {float, double}: каждое сочетание
+// получает собственные ядра, выбор между ними делается при компиляции по типам матриц
+#define INSTANTIATE_SEMIRING(Semiring, Index, Value)                                                           \
+    template MultiplyStats sparse_matrix_multiply<Semiring, Index, Value>(                                     \
+        const BasicDeviceCSRMatrix<Index, Value>&, const BasicDeviceCSRMatrix<Index, Value>&,                  \
+        BasicDeviceCSRMatrix<Index, Value>&, queue&, const SpGEMMBinning&);                                    \
+    template MultiplyStats sparse_matrix_multiply<Semiring, Index, Value>(                                     \
+        const BasicCSRView<Index, Value>&, const BasicCSRView<Index, Value>&, BasicCSRMatrix<Index, Value>&,   \
+        queue&, const SpGEMMBinning&, const std::vector<event>&);                                              \
+    template MultiplyStats sparse_matrix_multiply_single_pass<Semiring, Index, Value>(                         \
+        const BasicCSRView<Index, Value>&, const BasicCSRView<Index, Value>&, BasicCSRMatrix<Index, Value>&,   \
+        DeviceArena&, const SinglePassOptions&, const SpGEMMBinning&);
+
+#define INSTANTIATE_CSR(Index, Value)                                                                          \
+    template class BasicCSRMatrix<Index, Value>;                                                               \
+    template class BasicDeviceCSRMatrix<Index, Value>;                                                         \
+    template class BasicSpGEMMPlan<Index, Value>;                                                              \
+    template BasicCSRView<Index, Value> MappedCSRMatrix::view<Index, Value>() const;                           \
+    template BasicCSRMatrix<Index, Value> MappedCSRMatrix::to_matrix<Index, Value>() const;                    \
+    template void write_matrix_binary<Index, Value>(const BasicCSRView<Index, Value>&, const std::string&,     \
+                                                    uint32_t);                                                 \
+    template BasicCSRMatrix<Index, Value> sparse_matrix_transpose<Index, Value>(const BasicCSRView<Index, Value>&, \
+                                                                                queue&);                       \
+    template BasicCSRMatrix<Index, Value> read_matrix_from_file<Index, Value>(const std::string&);             \
+    template BasicCSRMatrix<Index, Value> read_matrix_market<Index, Value>(const std::string&, unsigned);      \
+    template BasicCSRMatrix<Index, Value> read_matrix<Index, Value>(const std::string&);                       \
+    template MultiplyStats multiply_pipeline<Index, Value>(                                                    \
+        size_t, const std::function<std::pair<BasicCSRMatrix<Index, Value>, BasicCSRMatrix<Index, Value>>(size_t)>&, \
+        const std::function<void(size_t, BasicCSRMatrix<Index, Value>&)>&, queue&, const SpGEMMBinning&);      \
+    INSTANTIATE_SEMIRING(PlusTimes, Index, Value)                                                              \
+    INSTANTIATE_SEMIRING(MinPlus, Index, Value)                                                                \
+    INSTANTIATE_SEMIRING(MaxTimes, Index, Value)                                                               \
+    INSTANTIATE_SEMIRING(OrAnd, Index, Value)                                                                  \
+    template MultiplyStats sparse_matrix_multiply<Index, Value>(const BasicCSRView<Index, Value>&,             \
+                                                                const BasicCSRView<Index, Value>&,             \
+                                                                BasicCSRMatrix<Index, Value>&,                 \
+                                                                std::vector<queue>&, const SpGEMMBinning&);    \
+    template struct BasicCSRBatch<Index, Value>;                                                               \
+    template MultiplyStats sparse_matrix_multiply_batched<Index, Value>(const BasicCSRBatch<Index, Value>&,    \
+                                                                        const BasicCSRBatch<Index, Value>&,    \
+                                                                        BasicCSRBatch<Index, Value>&, queue&); \
+    template MatrixPermutation<Index> compute_reordering<Index, Value>(const BasicCSRView<Index, Value>&,       \
+                                                                       Reordering);                            \
+    template BasicCSRMatrix<Index, Value> permute_matrix<Index, Value>(const BasicCSRView<Index, Value>&,       \
+                                                                       const MatrixPermutation<Index>&);       \
+    template MultiplyStats sparse_matrix_multiply_reordered<Index, Value>(                                     \
+        const BasicCSRView<Index, Value>&, const BasicCSRView<Index, Value>&, BasicCSRMatrix<Index, Value>&,   \
+        queue&, Reordering, MatrixPermutation<Index>*, const SpGEMMBinning&);                                  \
+    template struct BasicBSRMatrix<Index, Value>;                                                              \
+    template double bsr_fill_ratio<Index, Value>(const BasicCSRView<Index, Value>&, int);                      \
+    template int detect_block_size<Index, Value>(const BasicCSRView<Index, Value>&, double);                   \
+    template BasicBSRMatrix<Index, Value> csr_to_bsr<Index, Value>(const BasicCSRView<Index, Value>&, int);    \
+    template BasicCSRMatrix<Index, Value> bsr_to_csr<Index, Value>(const BasicBSRMatrix<Index, Value>&);       \
+    template MultiplyStats sparse_matrix_multiply<Index, Value>(const BasicBSRMatrix<Index, Value>&,           \
+                                                                const BasicBSRMatrix<Index, Value>&,           \
+                                                                BasicBSRMatrix<Index, Value>&, queue&);        \
+    template void sparse_matrix_vector_multiply<Index, Value>(const BasicBSRMatrix<Index, Value>&,             \
+                                                              const std::vector<Value>&, std::vector<Value>&,  \
+                                                              queue&);                                         \
+    template size_t estimate_product_nnz<Index, Value>(const BasicCSRView<Index, Value>&,                     \
+                                                       const BasicCSRView<Index, Value>&, NnzEstimator,        \
+                                                       size_t, unsigned);                                      \
+    template std::string chain_multiply_order<Index, Value>(const std::vector<BasicCSRView<Index, Value>>&);   \
+    template MultiplyStats sparse_matrix_chain_multiply<Index, Value>(                                         \
+        const std::vector<BasicCSRView<Index, Value>>&, BasicCSRMatrix<Index, Value>&, queue&,                 \
+        const SpGEMMBinning&);                                                                                 \
+    template MultiplyStats sparse_matrix_power<Index, Value>(const BasicCSRView<Index, Value>&, unsigned,      \
+                                                             BasicCSRMatrix<Index, Value>&, queue&,            \
+                                                             const SpGEMMBinning&);                            \
+    template MultiplyStats sparse_matrix_multiply_masked<Index, Value>(const BasicCSRView<Index, Value>&,      \
+                                                                       const BasicCSRView<Index, Value>&,      \
+                                                                       const BasicCSRMatrix<Index, Value>&,    \
+                                                                       BasicCSRMatrix<Index, Value>&, queue&,  \
+                                                                       MaskedSpGEMMKernel);                    \
+    template BasicCSRMatrix<Index, Value> undirected_lower_triangle<Index, Value>(                            \
+        const BasicCSRView<Index, Value>&);                                                                    \
+    template size_t count_triangles<Index, Value>(const BasicCSRView<Index, Value>&, queue&,                  \
+                                                  MaskedSpGEMMKernel);                                         \
+    template MultiplyStats sparse_matrix_multiply_to_file<Index, Value>(const BasicCSRView<Index, Value>&,     \
+                                                                        const BasicCSRView<Index, Value>&,     \
+                                                                        const std::string&, size_t, queue&,    \
+                                                                        const SpGEMMBinning&, uint32_t);       \
+    template void sparse_matrix_vector_multiply<Index, Value>(const BasicDeviceCSRMatrix<Index, Value>&,       \
+                                                              const Value*, Value*, queue&, SpMVKernel);       \
+    template void sparse_matrix_dense_multiply<Index, Value>(const BasicDeviceCSRMatrix<Index, Value>&,        \
+                                                             const Value*, Value*, size_t, queue&,           \
+                                                             SpMVKernel);                                      \
+    template void sparse_matrix_vector_multiply<Index, Value>(const BasicCSRView<Index, Value>&,               \
+                                                              const std::vector<Value>&, std::vector<Value>&,  \
+                                                              queue&, SpMVKernel);                             \
+    template void sparse_matrix_dense_multiply<Index, Value>(const BasicCSRView<Index, Value>&,                \
+                                                             const std::vector<Value>&, std::vector<Value>&,   \
+                                                             size_t, queue&, SpMVKernel);                      \
+    template void sparse_matrix_vector_multiply_host<Index, Value>(const BasicCSRView<Index, Value>&,          \
+                                                                   const Value*, Value*, unsigned);            \
+    template void sparse_matrix_dense_multiply_host<Index, Value>(const BasicCSRView<Index, Value>&,           \
+                                                                  const Value*, Value*, size_t, unsigned);
+
+INSTANTIATE_CSR(int32_t, float)
+INSTANTIATE_CSR(int32_t, double)
+INSTANTIATE_CSR(int64_t, float)
+INSTANTIATE_CSR(int64_t, double)
@@ -8,60 +8,49 @@
 #include <algorithm>
 #include <mkl.h>
 #include <iomanip>
+#include <cstdint>
+#include <memory>
+#include <limits>
+#include <future>
+#include <functional>
+#include <atomic>
+#include <cmath>
 
 #define eps 1e-10
 
 using namespace sycl;
 
-class CSRMatrix {
+template <class Index, class Value>
+struct TransposeCache;
+
+// CSR-матрица с индексами типа Index и значениями типа Value. Шаблоны матриц, чтения
+// и ядер явно инстанцированы для {int32_t, int64_t} x {float, double} в конце func.cpp;
+// CSRMatrix - основной вариант с int и double.
+template <class Index, class Value>
+class BasicCSRMatrix {
 public:
-    std::vector<int> row_ptr;   // Указатели на начало строк
-    std::vector<int> col_ind;   // Индексы столбцов ненулевых элементов
-    std::vector<double> values;  // Ненулевые значения
-    int rows, cols, non_zero_el; // Размеры матрицы, количсетво не нулевых элементов
+    using index_type = Index;
+    using value_type = Value;
+
+    std::vector<Index> row_ptr;   // Указатели на начало строк
+    std::vector<Index> col_ind;   // Индексы столбцов ненулевых элементов
+    std::vector<Value> values;  // Ненулевые значения
+    Index rows, cols, non_zero_el; // Размеры матрицы, количсетво не нулевых элементов
 
-    CSRMatrix() : CSRMatrix(0, 0) {}
+    BasicCSRMatrix() : BasicCSRMatrix(0, 0) {}
 
-    CSRMatrix(int rows, int cols) : rows(rows), cols(cols), non_zero_el(0) {
+    BasicCSRMatrix(Index rows, Index cols) : rows(rows), cols(cols), non_zero_el(0) {
         row_ptr.resize(rows + 1, 0);
     }
 
-    CSRMatrix(int r, int c, const std::vector<int>& rp, const std::vector<int>& ci, const std::vector<double>& v, int nze)
+    BasicCSRMatrix(Index r, Index c, const std::vector<Index>& rp, const std::vector<Index>& ci,
+                   const std::vector<Value>& v, Index nze)
         : rows(r), cols(c), row_ptr(rp), col_ind(ci), values(v), non_zero_el(nze) {
             row_ptr.resize(rows + 1, 0);
     }
 
-    // Функция для чтения матрицы из файла
-    static CSRMatrix readFromFile(const std::string& filename) {
-        std::ifstream file(filename);
-        if (!file.is_open()) {
-            throw std::runtime_error("Не удалось открыть файл: " + filename);
-        }
-
-        int rows, cols;
-        file >> rows >> cols;
-
-        CSRMatrix matrix(rows, cols);
-
-        for (int i = 0; i <= rows; ++i) {
-            file >> matrix.row_ptr[i];
-        }
-
-        int non_zero_elements = matrix.row_ptr.back();  // Количество ненулевых элементов
-        matrix.col_ind.resize(non_zero_elements);
-        matrix.values.resize(non_zero_elements);
-
-        for (int i = 0; i < non_zero_elements; ++i) {
-            file >> matrix.col_ind[i];
-        }
-
-        for (int i = 0; i < non_zero_elements; ++i) {
-            file >> matrix.values[i];
-        }
-
-        file.close();
-        return matrix;
-    }
+    // Чтение матрицы из текстового файла; то же, что read_matrix_from_file
+    static BasicCSRMatrix readFromFile(const std::string& filename);
 
     // Функция для вывода матрицы
     void print() const {
@@ -80,39 +69,39 @@ public:
         std::cout << std::endl;
     }
 
-     CSRMatrix transpose() const {
+     BasicCSRMatrix transpose() const {
         // Новые размеры
-        int transposed_rows = cols;
-        int transposed_cols = rows;
-        int non_z_e = non_zero_el;
+        Index transposed_rows = cols;
+        Index transposed_cols = rows;
+        Index non_z_e = non_zero_el;
 
 
         // Количество ненулевых элементов в каждом столбце исходной матрицы (т.е. строке транспонированной)
-        std::vector<int> row_count(transposed_rows, 0);
+        std::vector<Index> row_count(transposed_rows, 0);
         
         // Подсчет ненулевых элементов в каждом столбце исходной матрицы
-        for (int col : col_ind) {
+        for (Index col : col_ind) {
             row_count[col]++;
         }
 
         // Построение нового row_ptr для транспонированной матрицы
-        std::vector<int> transposed_row_ptr(transposed_rows + 1, 0);
-        for (int i = 0; i < transposed_rows; ++i) {
+        std::vector<Index> transposed_row_ptr(transposed_rows + 1, 0);
+        for (Index i = 0; i < transposed_rows; ++i) {
             transposed_row_ptr[i + 1] = transposed_row_ptr[i] + row_count[i];
         }
 
         // Массивы для хранения индексов и значений транспонированной матрицы
-        std::vector<int> transposed_col_ind(col_ind.size());
-        std::vector<double> transposed_values(values.size());
+        std::vector<Index> transposed_col_ind(col_ind.size());
+        std::vector<Value> transposed_values(values.size());
 
         // Временный массив для отслеживания позиций вставки для каждого столбца (строки в транспонированной)
-        std::vector<int> current_pos = transposed_row_ptr;
+        std::vector<Index> current_pos = transposed_row_ptr;
 
         // Заполнение новых col_ind и values
-        for (int i = 0; i < rows; ++i) {
-            for (int j = row_ptr[i]; j < row_ptr[i + 1]; ++j) {
-                int col = col_ind[j];
-                int dest_pos = current_pos[col];
+        for (Index i = 0; i < rows; ++i) {
+            for (Index j = row_ptr[i]; j < row_ptr[i + 1]; ++j) {
+                Index col = col_ind[j];
+                Index dest_pos = current_pos[col];
 
                 transposed_col_ind[dest_pos] = i;      // Строка в исходной матрице становится столбцом
                 transposed_values[dest_pos] = values[j]; // Переносим значение
@@ -121,11 +110,211 @@ public:
             }
         }
 
-        return CSRMatrix(transposed_rows, transposed_cols, transposed_row_ptr, transposed_col_ind, transposed_values, non_z_e);
+        return BasicCSRMatrix(transposed_rows, transposed_cols, transposed_row_ptr, transposed_col_ind, transposed_values, non_z_e);
     }
+
+    // Копия матрицы с другими типами индексов и значений
+    template <class OtherIndex, class OtherValue>
+    BasicCSRMatrix<OtherIndex, OtherValue> cast() const {
+        return BasicCSRMatrix<OtherIndex, OtherValue>(
+            static_cast<OtherIndex>(rows), static_cast<OtherIndex>(cols),
+            std::vector<OtherIndex>(row_ptr.begin(), row_ptr.end()),
+            std::vector<OtherIndex>(col_ind.begin(), col_ind.end()),
+            std::vector<OtherValue>(values.begin(), values.end()),
+            static_cast<OtherIndex>(non_zero_el));
+    }
+
+    // Транспонированная матрица (CSC-представление), построенная на устройстве и закешированная.
+    // Кеш перестраивается, если массивы матрицы были перевыделены или изменили размер, либо
+    // сменилась версия матрицы. Изменение row_ptr, col_ind или values на месте (без
+    // перевыделения) не отслеживается: после него нужно вызвать invalidate_transposed().
+    // Можно вызывать из нескольких потоков одновременно, пока матрица не изменяется.
+    const BasicCSRMatrix& transposed(queue& q) const;
+
+    // Новая версия матрицы после изменения массивов на месте; освобождает кеш транспонированной
+    void invalidate_transposed() {
+        static std::atomic<uint64_t> last_version{0};
+        version_ = ++last_version;
+        std::atomic_store(&transpose_cache, std::shared_ptr<TransposeCache<Index, Value>>());
+    }
+
+    // Версия содержимого: 0 у новой матрицы, иначе номер, уникальный среди всех матриц этого
+    // типа, выданный последним invalidate_transposed(); копируется и переносится с массивами
+    uint64_t version() const { return version_; }
+
+private:
+    uint64_t version_ = 0;
+    mutable std::shared_ptr<TransposeCache<Index, Value>> transpose_cache;
+};
+
+using CSRMatrix = BasicCSRMatrix<int, double>;
+
+// Совпадение структуры и значений X и Y. Порядок сложения в ядрах не фиксирован, поэтому
+// значения сравниваются с относительной погрешностью tolerance
+template <class Index, class Value>
+bool same_matrix(const BasicCSRMatrix<Index, Value>& X, const BasicCSRMatrix<Index, Value>& Y,
+                 double tolerance = eps) {
+    bool same = X.rows == Y.rows && X.cols == Y.cols && X.row_ptr == Y.row_ptr && X.col_ind == Y.col_ind &&
+                X.values.size() == Y.values.size();
+    for (size_t i = 0; same && i < X.values.size(); i++) {
+        double y = Y.values[i];
+        same = std::fabs(X.values[i] - y) <= tolerance * std::max(1.0, std::fabs(y));
+    }
+    return same;
+}
+
+// Невладеющее представление CSR-матрицы: массивы могут принадлежать CSRMatrix
+// или лежать в отображенном в память файле (MappedCSRMatrix)
+template <class Index, class Value>
+struct BasicCSRView {
+    Index rows, cols;
+    size_t nnz;
+    const Index* row_ptr;
+    const Index* col_ind;
+    const Value* values;
+
+    BasicCSRView(Index rows, Index cols, size_t nnz, const Index* row_ptr, const Index* col_ind, const Value* values)
+        : rows(rows), cols(cols), nnz(nnz), row_ptr(row_ptr), col_ind(col_ind), values(values) {}
+
+    // Число ненулевых элементов берется из col_ind: non_zero_el заполняют не все конструкторы
+    BasicCSRView(const BasicCSRMatrix<Index, Value>& m)
+        : rows(m.rows), cols(m.cols), nnz(m.col_ind.size()),
+          row_ptr(m.row_ptr.data()), col_ind(m.col_ind.data()), values(m.values.data()) {}
+};
+
+using CSRView = BasicCSRView<int, double>;
+
+// Пакет CSR-матриц в общих массивах. Строки матрицы b занимают row_ptr[row_offset[b],
+// row_offset[b + 1]], row_ptr содержит смещения в общих col_ind/values, а номера столбцов
+// отсчитываются внутри своей матрицы.
+template <class Index, class Value>
+struct BasicCSRBatch {
+    std::vector<Index> row_offset = {0};
+    std::vector<Index> cols;
+    std::vector<Index> row_ptr = {0};
+    std::vector<Index> col_ind;
+    std::vector<Value> values;
+
+    size_t size() const { return cols.size(); }
+    Index rows(size_t b) const { return row_offset[b + 1] - row_offset[b]; }
+    size_t nnz(size_t b) const { return row_ptr[row_offset[b + 1]] - row_ptr[row_offset[b]]; }
+
+    // Добавление матрицы в конец пакета
+    void push_back(const BasicCSRView<Index, Value>& M);
+    // Копия матрицы b
+    BasicCSRMatrix<Index, Value> matrix(size_t b) const;
+};
+
+using CSRBatch = BasicCSRBatch<int, double>;
+
+// Блочная CSR-матрица (BSR): ненулевые блоки block x block хранятся плотно построчно
+// (values[p * block * block + r * block + c]), row_ptr и col_ind индексируют блочные строки
+// и столбцы. rows и cols - размеры в элементах; последние блочные строка и столбец
+// дополняются нулями до кратных block. Один индекс столбца приходится на block^2 значений.
+template <class Index, class Value>
+struct BasicBSRMatrix {
+    Index rows, cols;
+    int block;
+    std::vector<Index> row_ptr;
+    std::vector<Index> col_ind;
+    std::vector<Value> values;
+
+    BasicBSRMatrix() : BasicBSRMatrix(0, 0, 1) {}
+    BasicBSRMatrix(Index rows, Index cols, int block)
+        : rows(rows), cols(cols), block(block), row_ptr((rows + block - 1) / block + 1, 0) {}
+
+    Index block_rows() const { return (rows + block - 1) / block; }
+    Index block_cols() const { return (cols + block - 1) / block; }
+    size_t blocks() const { return col_ind.size(); }
+
+    // Заполнение: число хранимых значений на ненулевой элемент (|v| > eps), 1 - без явных нулей
+    double fill_ratio() const;
+};
+
+using BSRMatrix = BasicBSRMatrix<int, double>;
+
+// Параметр, не участвующий в выводе аргументов шаблона: типы берутся из других параметров,
+// а CSRMatrix и MappedCSRMatrix неявно приводятся к представлению
+template <class T>
+struct non_deduced {
+    using type = T;
+};
+
+template <class T>
+using non_deduced_t = typename non_deduced<T>::type;
+
+// Двоичный формат CSR: заголовок и массивы row_ptr, col_ind, values, каждый из которых
+// выровнен на alignment байт от начала файла. Файл отображается в память через mmap,
+// и массивы используются на месте, без разбора и копирования.
+#define CSR_BINARY_MAGIC "CSRBIN"
+#define CSR_BINARY_VERSION 1
+
+struct CSRBinaryHeader {
+    char magic[8];            // CSR_BINARY_MAGIC, дополненный нулями
+    uint32_t version;         // CSR_BINARY_VERSION
+    uint32_t index_width;     // Размер элемента row_ptr/col_ind в байтах (4 или 8)
+    uint32_t value_width;     // Размер элемента values в байтах (4 или 8)
+    uint32_t alignment;       // Выравнивание массивов (степень двойки)
+    int64_t rows, cols, nnz;
+    uint64_t row_ptr_offset;  // Смещения массивов от начала файла
+    uint64_t col_ind_offset;
+    uint64_t values_offset;
+};
+
+// Матрица из двоичного файла, отображенного в память только для чтения. Типы индексов
+// и значений задаются при обращении и должны совпадать с размерами из заголовка.
+class MappedCSRMatrix {
+public:
+    explicit MappedCSRMatrix(const std::string& filename);
+    ~MappedCSRMatrix();
+
+    MappedCSRMatrix(const MappedCSRMatrix&) = delete;
+    MappedCSRMatrix& operator=(const MappedCSRMatrix&) = delete;
+    MappedCSRMatrix(MappedCSRMatrix&& other) noexcept;
+    MappedCSRMatrix& operator=(MappedCSRMatrix&& other) noexcept;
+
+    const CSRBinaryHeader& header() const { return *static_cast<const CSRBinaryHeader*>(data); }
+
+    template <class Index = int, class Value = double>
+    BasicCSRView<Index, Value> view() const;
+
+    template <class Index, class Value>
+    operator BasicCSRView<Index, Value>() const { return view<Index, Value>(); }
+
+    // Копия в обычную CSR-матрицу
+    template <class Index = int, class Value = double>
+    BasicCSRMatrix<Index, Value> to_matrix() const;
+
+private:
+    void* data;
+    size_t size;
 };
 
-auto nvidia_selector = [](const device& dev) {
+// Запись матрицы в двоичный формат CSR
+template <class Index, class Value>
+void write_matrix_binary(const BasicCSRView<Index, Value>& matrix, const std::string& filename,
+                         uint32_t alignment = 4096);
+
+template <class Index, class Value>
+void write_matrix_binary(const BasicCSRMatrix<Index, Value>& matrix, const std::string& filename,
+                         uint32_t alignment = 4096) {
+    write_matrix_binary(BasicCSRView<Index, Value>(matrix), filename, alignment);
+}
+
+// Параллельное транспонирование на устройстве: гистограмма столбцов, префиксная сумма,
+// атомарная раскладка элементов и сортировка строк результата
+template <class Index, class Value>
+BasicCSRMatrix<Index, Value> sparse_matrix_transpose(const BasicCSRView<Index, Value>& M, queue& q);
+
+template <class Index, class Value>
+BasicCSRMatrix<Index, Value> sparse_matrix_transpose(const BasicCSRMatrix<Index, Value>& M, queue& q) {
+    return sparse_matrix_transpose(BasicCSRView<Index, Value>(M), q);
+}
+
+// Однократное преобразование текстового файла (формат read_matrix_from_file) в двоичный
+void convert_text_to_binary(const std::string& text_filename, const std::string& binary_filename);
+
+inline auto nvidia_selector = [](const device& dev) {
     const std::string name = dev.get_info<info::device::name>();
     if (name.find("NVIDIA") != std::string::npos) {
         return 1;  // Максимальный приоритет для NVIDIA устройств
@@ -147,10 +336,611 @@ static auto exception_handler = [](sycl::exception_list e_list) {
     }
 };
 
+// План умножения C = A * B для матриц с неизменным шаблоном разреженности.
+// Конструктор выполняет символьный этап: строит row_ptr/col_ind результата и раскладку
+// аккумуляторов строк, в которых для каждого столбца хранится позиция элемента в C.
+// execute выполняет только численный этап - один запуск ядра без выделения памяти.
+// Шаблон C структурный: элементы, обнулившиеся при сложении, в нем остаются.
+template <class Index, class Value>
+class BasicSpGEMMPlan {
+public:
+    BasicSpGEMMPlan(const BasicCSRView<Index, Value>& A, const BasicCSRView<Index, Value>& B, queue& q);
+
+    // A и B должны иметь тот же шаблон разреженности, что и при построении плана. Если
+    // переданы другие массивы row_ptr/col_ind (в отладочной сборке - всегда), шаблон
+    // сверяется по контрольной сумме, и при несовпадении выбрасывается исключение.
+    // row_ptr/col_ind результата копируются в C, только если C не получила их от этого
+    // плана в предыдущем вызове (те же массивы и версия C); иначе обновляются лишь values.
+    void execute(const BasicCSRView<Index, Value>& A, const BasicCSRView<Index, Value>& B,
+                 BasicCSRMatrix<Index, Value>& C);
+
+    const BasicCSRMatrix<Index, Value>& pattern() const { return C_pattern; }
+
+private:
+    queue q;
+    BasicCSRMatrix<Index, Value> C_pattern;
+    size_t nnz_A, nnz_B;
+    const Index* pattern_arrays[4]; // row_ptr и col_ind A и B, по которым построен план
+    uint64_t checksum;              // Контрольная сумма шаблонов A и B
+    const Index* result_arrays[2] = {}; // row_ptr и col_ind C, в которые последний раз записан шаблон
+    uint64_t result_version = 0;        // Версия C после последнего вызова execute
+
+    buffer<Index, 1> buf_row_ptr_A, buf_col_ind_A, buf_row_ptr_B, buf_col_ind_B;
+    buffer<Value, 1> buf_values_A, buf_values_B;
+    buffer<size_t, 1> buf_acc_offset;
+    buffer<Index, 1> buf_keys;      // Столбцы в аккумуляторах строк
+    buffer<Index, 1> buf_positions; // Позиции соответствующих элементов в C.values
+    buffer<Index, 1> buf_row_ptr_C;
+    buffer<Value, 1> buf_values_C;
+};
+
+using SpGEMMPlan = BasicSpGEMMPlan<int, double>;
+
+// CSR-матрица в памяти устройства (USM). Результаты умножения остаются на устройстве,
+// поэтому цепочки A * B * C и итерационные алгоритмы копируют на хост только итог.
+template <class Index, class Value>
+class BasicDeviceCSRMatrix {
+public:
+    using index_type = Index;
+    using value_type = Value;
+
+    Index rows, cols;
+    size_t nnz;
+    Index* row_ptr;
+    Index* col_ind;
+    Value* values;
+
+    explicit BasicDeviceCSRMatrix(queue& q);
+
+    // Копирование матрицы с хоста на устройство
+    BasicDeviceCSRMatrix(const BasicCSRView<Index, Value>& M, queue& q);
+
+    ~BasicDeviceCSRMatrix();
+
+    BasicDeviceCSRMatrix(const BasicDeviceCSRMatrix&) = delete;
+    BasicDeviceCSRMatrix& operator=(const BasicDeviceCSRMatrix&) = delete;
+    BasicDeviceCSRMatrix(BasicDeviceCSRMatrix&& other) noexcept;
+    BasicDeviceCSRMatrix& operator=(BasicDeviceCSRMatrix&& other) noexcept;
+
+    // Память матрицы только растет: буферы сохраняются, если их емкости хватает для новых
+    // размеров, поэтому результат, многократно перезаписываемый умножением (степень
+    // матрицы, цепочка), выделяет память на устройстве только при росте. Прежнее
+    // содержимое при выделении не сохраняется.
+
+    // Выделение памяти под матрицу заданных размеров; row_ptr заполняется нулями
+    void allocate(Index rows, Index cols, size_t nnz);
+
+    // Выделение в два шага для результата, nnz которого вычисляется на устройстве по row_ptr:
+    // allocate_rows - row_ptr под rows строк без заполнения (nnz = 0), allocate_nnz - col_ind
+    // и values под nnz элементов с сохранением row_ptr
+    void allocate_rows(Index rows, Index cols);
+    void allocate_nnz(size_t nnz);
+
+    // Емкость не меньше rows строк и nnz элементов без изменения размеров матрицы
+    void reserve(Index rows, size_t nnz);
+
+    size_t row_capacity() const { return row_capacity_; }
+    size_t nnz_capacity() const { return nnz_capacity_; }
+
+    // Копирование матрицы на хост
+    BasicCSRMatrix<Index, Value> to_host() const;
+
+private:
+    mutable queue q;
+    size_t row_capacity_ = 0;  // емкость row_ptr в строках (row_ptr длиной row_capacity_ + 1)
+    size_t nnz_capacity_ = 0;  // емкость col_ind и values
+
+    void release();
+};
+
+using DeviceCSRMatrix = BasicDeviceCSRMatrix<int, double>;
+
+// Полукольца SpGEMM, подставляемые в ядра на этапе компиляции. zero() - нейтральный
+// элемент сложения (начальное значение аккумулятора), keep(v) - попадает ли сумма в C,
+// atomic_add - сложение в ячейку, общую для группы рабочих элементов. Полукольцо без
+// значений (has_values == false) работает только со структурой: values сомножителей
+// не копируются и не читаются, а все элементы C равны 1.
+
+// Обычное умножение; элементы с |sum| <= eps отбрасываются
+struct PlusTimes {
+    static constexpr bool has_values = true;
+    template <class Value> static Value zero() { return 0; }
+    template <class Value> static Value add(Value a, Value b) { return a + b; }
+    template <class Value> static Value multiply(Value a, Value b) { return a * b; }
+    template <class Value> static bool keep(Value v) { return sycl::fabs(v) > static_cast<Value>(eps); }
+    template <class Ref, class Value> static void atomic_add(Ref ref, Value v) { ref.fetch_add(v); }
+};
+
+// Кратчайшие пути: сложение - минимум, умножение - сумма, ноль - +inf
+struct MinPlus {
+    static constexpr bool has_values = true;
+    template <class Value> static Value zero() { return std::numeric_limits<Value>::infinity(); }
+    template <class Value> static Value add(Value a, Value b) { return sycl::fmin(a, b); }
+    template <class Value> static Value multiply(Value a, Value b) { return a + b; }
+    template <class Value> static bool keep(Value v) { return v != std::numeric_limits<Value>::infinity(); }
+    template <class Ref, class Value> static void atomic_add(Ref ref, Value v) { ref.fetch_min(v); }
+};
+
+// Наиболее вероятные пути (Витерби) для неотрицательных весов: сложение - максимум
+struct MaxTimes {
+    static constexpr bool has_values = true;
+    template <class Value> static Value zero() { return 0; }
+    template <class Value> static Value add(Value a, Value b) { return sycl::fmax(a, b); }
+    template <class Value> static Value multiply(Value a, Value b) { return a * b; }
+    template <class Value> static bool keep(Value v) { return v > 0; }
+    template <class Ref, class Value> static void atomic_add(Ref ref, Value v) { ref.fetch_max(v); }
+};
+
+// Достижимость (фронт BFS): C содержит структуру A * B без значений
+struct OrAnd {
+    static constexpr bool has_values = false;
+    template <class Value> static Value zero() { return 0; }
+    template <class Value> static Value add(Value a, Value b) { return (a != 0 || b != 0) ? 1 : 0; }
+    template <class Value> static Value multiply(Value a, Value b) { return (a != 0 && b != 0) ? 1 : 0; }
+    template <class Value> static bool keep(Value) { return true; }
+    template <class Ref, class Value> static void atomic_add(Ref ref, Value v) { ref.fetch_max(v); }
+};
+
+// Пороги разбиения строк C по верхней оценке числа произведений (flops)
+struct SpGEMMBinning {
+    size_t tiny_max = 32;     // До tiny_max - строка на рабочий элемент
+    size_t medium_max = 1024; // До medium_max - строка на подгруппу, тяжелее - на рабочую группу
+};
+
+// Статистика корзин строк: 0 - короткие, 1 - средние, 2 - тяжелые
+struct SpGEMMBinStats {
+    size_t rows[3] = {};
+    size_t flops[3] = {};
+    size_t max_flops[3] = {};
+
+    void print() const;
+};
+
+// Статистика одного умножения. Времена этапов в секундах: для ядер и копирований берутся
+// из событий SYCL, если очередь создана с property::queue::enable_profiling
+// (см. make_profiling_queue), иначе измеряются часами хоста вокруг ожидания.
+// Если задана переменная окружения SPGEMM_STATS_JSON, статистика каждого умножения
+// дописывается в этот файл строкой JSON ("-" - вывод в stdout).
+struct MultiplyStats {
+    double upload = 0;    // копирование A и B на устройство
+    double binning = 0;   // оценка flops строк и разбиение по корзинам
+    double scan = 0;      // префиксные суммы раскладки аккумуляторов и row_ptr
+    double symbolic = 0;  // ядра символьного этапа (накопление и подсчет nnz строк)
+    double numeric = 0;   // ядра численного этапа (сжатие и запись строк C)
+    double transfer = 0;  // чтение счетчиков, размеров и nnz(C) на хост
+    double download = 0;  // копирование C на хост
+    double load = 0;      // ожидание загрузки входных матриц в конвейере multiply_pipeline
+    double reorder = 0;   // вычисление перестановок и перестановка A, B и C на хосте
+    double write = 0;     // запись панелей C в файл (в потоке записи, параллельно с умножением)
+    double total = 0;     // полное время вызова по часам хоста
+
+    size_t bytes_to_device = 0;
+    size_t bytes_from_device = 0;
+    size_t products = 0;           // число произведений a_ik * b_kj, flops = 2 * products
+    size_t nnz_C = 0;
+    size_t peak_scratch_bytes = 0; // пик временной памяти устройства (без A, B и C)
+    size_t panels = 1;             // число панелей строк A (потоковое умножение, несколько очередей)
+    size_t overflow_rows = 0;      // строки, превысившие оценку длины (однопроходное умножение)
+    bool device_timing = false;    // времена ядер и копирований взяты из событий SYCL
+
+    SpGEMMBinStats bins;
+
+    double gflops() const { return total > 0 ? 2.0 * products / total * 1e-9 : 0.0; }
+    std::string to_json() const;
+    void print() const;
+};
+
+// Очередь с профилированием событий, чтобы MultiplyStats содержала время устройства
+template <class Selector>
+queue make_profiling_queue(const Selector& selector) {
+    return queue(selector, exception_handler, property_list{property::queue::enable_profiling()});
+}
+
+// Очереди на подустройствах, по одной на домен NUMA. Если устройство не делится по
+// доменам NUMA, возвращается одна очередь на всем устройстве.
+std::vector<queue> make_numa_queues(const device& dev, bool profiling = false);
+
+// C = A * B для матриц в памяти устройства. Строки разбиваются на корзины по числу
+// произведений, и для каждой запускается свой вариант ядра. Префиксные суммы row_ptr
+// и раскладки аккумуляторов считаются на устройстве; на хост читаются только счетчики
+// корзин, размер рабочего буфера и nnz(C), нужные для запусков и выделения памяти.
+// Полукольцо задается первым аргументом шаблона: sparse_matrix_multiply<MinPlus>(A, B, C, q).
+template <class Semiring = PlusTimes, class Index, class Value>
+MultiplyStats sparse_matrix_multiply(const BasicDeviceCSRMatrix<Index, Value>& A,
+                                     const BasicDeviceCSRMatrix<Index, Value>& B,
+                                     BasicDeviceCSRMatrix<Index, Value>& C,
+                                     queue& q, const SpGEMMBinning& binning = SpGEMMBinning());
+
+// C = A * B через SpGEMMPlan (символьный и численный этапы)
 CSRMatrix csr_matrix_multiply(const CSRMatrix& A, const CSRMatrix& B, CSRMatrix &C, queue& q);
 
-CSRMatrix read_matrix_from_file(const std::string& filename);
+// Чтение текстового файла: строка "rows nnz" (матрица квадратная), затем row_ptr, col_ind
+// и values. Если row_ptr[rows] не равен nnz из заголовка, выбрасывается исключение.
+template <class Index = int, class Value = double>
+BasicCSRMatrix<Index, Value> read_matrix_from_file(const std::string& filename);
+
+template <class Index, class Value>
+BasicCSRMatrix<Index, Value> BasicCSRMatrix<Index, Value>::readFromFile(const std::string& filename) {
+    return read_matrix_from_file<Index, Value>(filename);
+}
+
+// Параллельное чтение файла Matrix Market (coordinate; real/integer/pattern;
+// general/symmetric/skew-symmetric). Файл делится на диапазоны байтов по числу потоков
+// (0 - по числу ядер), столбцы в строках сортируются, повторы суммируются.
+template <class Index = int, class Value = double>
+BasicCSRMatrix<Index, Value> read_matrix_market(const std::string& filename, unsigned num_threads = 0);
+
+// Чтение матрицы с выбором формата по расширению: .mtx - Matrix Market, .bin - двоичный
+// CSR (копия из отображенного файла), иначе текстовый формат read_matrix_from_file
+template <class Index = int, class Value = double>
+BasicCSRMatrix<Index, Value> read_matrix(const std::string& filename);
+
+// Генераторы тестовых матриц со случайными значениями из [0.5, 1.5):
+// равномерно случайная матрица заданной плотности
+CSRMatrix generate_uniform_random(int rows, int cols, double density, unsigned seed = 1);
+
+// Ленточная матрица n x n (разностный шаблон) с полушириной ленты half_bandwidth
+CSRMatrix generate_banded(int n, int half_bandwidth, unsigned seed = 1);
+
+// Ленточная матрица из плотных блоков block x block (сборка МКЭ с block степенями свободы
+// в узле): n_nodes блочных строк, полуширина ленты half_bandwidth в узлах
+CSRMatrix generate_block_banded(int n_nodes, int half_bandwidth, int block, unsigned seed = 1);
+
+// Граф R-MAT со степенным распределением: 2^scale вершин, edge_factor * 2^scale ребер
+CSRMatrix generate_rmat(int scale, int edge_factor, double a = 0.57, double b = 0.19, double c = 0.19, unsigned seed = 1);
 
 void Available_platforms();
 
-void sparse_matrix_multiply(const CSRMatrix& A, const CSRMatrix& B, CSRMatrix &C, queue& q);
\ No newline at end of file
+// C = A * B построчным алгоритмом Густавсона: строка C накапливается только по строкам B,
+// на которые указывают ненулевые элементы строки A (хеш-таблица или плотный массив на строку).
+// Матрицы копируются на устройство, и умножение выполняется как для DeviceCSRMatrix.
+// Копирование A и B в очереди начинается после событий depends (например, заполнения
+// входных массивов ядрами в той же или другой очереди).
+// Типы индексов и значений определяются по C, полукольцо - первым аргументом шаблона.
+template <class Semiring = PlusTimes, class Index, class Value>
+MultiplyStats sparse_matrix_multiply(const non_deduced_t<BasicCSRView<Index, Value>>& A,
+                                     const non_deduced_t<BasicCSRView<Index, Value>>& B,
+                                     BasicCSRMatrix<Index, Value> &C, queue& q,
+                                     const SpGEMMBinning& binning = SpGEMMBinning(),
+                                     const std::vector<event>& depends = {});
+
+// Асинхронное C = A * B - обертка над sparse_matrix_multiply в отдельном потоке хоста:
+// вызывающий поток не блокируется, но внутри потока умножение, как и синхронное, ждет
+// завершения своих этапов. События depends передаются в очередь как зависимости
+// копирования A и B, поток хоста их не ожидает. Массивы A и B и матрица C должны
+// существовать до готовности future.
+template <class Semiring = PlusTimes, class Index, class Value>
+std::future<MultiplyStats> sparse_matrix_multiply_async(const non_deduced_t<BasicCSRView<Index, Value>>& A,
+                                                        const non_deduced_t<BasicCSRView<Index, Value>>& B,
+                                                        BasicCSRMatrix<Index, Value>& C, queue& q,
+                                                        std::vector<event> depends = {},
+                                                        SpGEMMBinning binning = SpGEMMBinning()) {
+    BasicCSRView<Index, Value> a = A, b = B;
+    return std::async(std::launch::async, [a, b, &C, &q, depends = std::move(depends), binning]() {
+        return sparse_matrix_multiply<Semiring, Index, Value>(a, b, C, q, binning, depends);
+    });
+}
+
+// Конвейер умножений: load(i) читает и разбирает пару (A_i, B_i) в потоке хоста, пока на
+// очереди умножается пара i - 1; consume(i, C_i) получает результат. Время конвейера
+// ограничено более медленным из этапов, а не их суммой. Статистика суммируется по
+// парам, load - время ожидания загрузки, total - полное время конвейера.
+template <class Index, class Value>
+MultiplyStats multiply_pipeline(
+    size_t count,
+    const std::function<std::pair<BasicCSRMatrix<Index, Value>, BasicCSRMatrix<Index, Value>>(size_t)>& load,
+    const std::function<void(size_t, BasicCSRMatrix<Index, Value>&)>& consume, queue& q,
+    const SpGEMMBinning& binning = SpGEMMBinning());
+
+// C = A * B на нескольких очередях, например из make_numa_queues. Строки A делятся на
+// непрерывные диапазоны с равным числом произведений; каждая очередь получает копию своих
+// строк A и собственную копию B, диапазоны считаются одновременно, а сегменты row_ptr C
+// сшиваются со сдвигом на nnz предыдущих диапазонов. Времена этапов в статистике -
+// максимум по очередям, счетчики - сумма.
+template <class Index, class Value>
+MultiplyStats sparse_matrix_multiply(const non_deduced_t<BasicCSRView<Index, Value>>& A,
+                                     const non_deduced_t<BasicCSRView<Index, Value>>& B,
+                                     BasicCSRMatrix<Index, Value> &C, std::vector<queue>& queues,
+                                     const SpGEMMBinning& binning = SpGEMMBinning());
+
+// C_b = A_b * B_b для всех пар пакетов A и B. Каждой паре назначается рабочая группа,
+// строки накапливаются в аккумуляторах рабочего буфера за один запуск, после чтения
+// длин строк и префиксной суммы на хосте второй запуск собирает пакет C. Предназначено
+// для тысяч маленьких матриц, для которых отдельные вызовы sparse_matrix_multiply
+// упираются в накладные расходы запусков и копирований.
+template <class Index, class Value>
+MultiplyStats sparse_matrix_multiply_batched(const BasicCSRBatch<Index, Value>& A, const BasicCSRBatch<Index, Value>& B,
+                                             BasicCSRBatch<Index, Value>& C, queue& q);
+
+// Форма маскированного умножения: скалярное произведение строки A и столбца B (строки
+// кэшированной B^T) на каждый элемент маски, построчный алгоритм Густавсона с пропуском
+// столбцов вне маски или выбор по оценке числа операций (automatic)
+enum class MaskedSpGEMMKernel { automatic, dot, gustavson };
+
+// C = M ⊙ (A * B): вычисляются только элементы, стоящие в позициях ненулевых элементов M;
+// значения M не используются. Как и в немаскированном умножении, нулевые суммы в C не
+// попадают. Столбцы в строках M, A и B должны быть упорядочены. Число произведений в
+// статистике - flops немаскированного A * B.
+template <class Index, class Value>
+MultiplyStats sparse_matrix_multiply_masked(const non_deduced_t<BasicCSRView<Index, Value>>& M,
+                                            const non_deduced_t<BasicCSRView<Index, Value>>& A,
+                                            const BasicCSRMatrix<Index, Value>& B, BasicCSRMatrix<Index, Value>& C,
+                                            queue& q, MaskedSpGEMMKernel kernel = MaskedSpGEMMKernel::automatic);
+
+// Строго нижний треугольник неориентированного графа с матрицей смежности A: ребра берутся
+// из A и A^T, петли отбрасываются, значения равны 1
+template <class Index, class Value>
+BasicCSRMatrix<Index, Value> undirected_lower_triangle(const BasicCSRView<Index, Value>& A);
+
+template <class Index, class Value>
+BasicCSRMatrix<Index, Value> undirected_lower_triangle(const BasicCSRMatrix<Index, Value>& A) {
+    return undirected_lower_triangle(BasicCSRView<Index, Value>(A));
+}
+
+// Число треугольников графа A: сумма элементов L ⊙ (L * L), L = undirected_lower_triangle(A)
+template <class Index, class Value>
+size_t count_triangles(const BasicCSRView<Index, Value>& A, queue& q,
+                       MaskedSpGEMMKernel kernel = MaskedSpGEMMKernel::automatic);
+
+template <class Index, class Value>
+size_t count_triangles(const BasicCSRMatrix<Index, Value>& A, queue& q,
+                       MaskedSpGEMMKernel kernel = MaskedSpGEMMKernel::automatic) {
+    return count_triangles(BasicCSRView<Index, Value>(A), q, kernel);
+}
+
+// Переупорядочивание для локальности обращений к B: обратный алгоритм Катхилл-Макки по
+// симметризованной структуре (rcm) и сортировка вершин по убыванию степени (degree) -
+// симметричные перестановки квадратной матрицы; сортировка строк по убыванию длины
+// (row_length) переставляет только строки.
+enum class Reordering { none, rcm, degree, row_length };
+
+// Перестановки строк и столбцов: элемент new -> old. Пустой вектор - тождественная перестановка.
+template <class Index>
+struct MatrixPermutation {
+    std::vector<Index> rows;
+    std::vector<Index> cols;
+};
+
+template <class Index, class Value>
+MatrixPermutation<Index> compute_reordering(const BasicCSRView<Index, Value>& A, Reordering method);
+
+// A'[i][j] = A[perm.rows[i]][perm.cols[j]]; столбцы в строках результата упорядочены
+template <class Index, class Value>
+BasicCSRMatrix<Index, Value> permute_matrix(const BasicCSRView<Index, Value>& A, const MatrixPermutation<Index>& perm);
+
+template <class Index, class Value>
+BasicCSRMatrix<Index, Value> permute_matrix(const BasicCSRMatrix<Index, Value>& A, const MatrixPermutation<Index>& perm) {
+    return permute_matrix(BasicCSRView<Index, Value>(A), perm);
+}
+
+// C = A * B с переупорядочиванием: перестановка вычисляется по A, A и B переставляются
+// согласованно (A' = P A Q^T, B' = Q B R^T), и C' = P C R^T переставляется обратно.
+// Если c_perm не нулевой, C остается в переставленном порядке, а в *c_perm
+// записываются его перестановки (P, R).
+template <class Index, class Value>
+MultiplyStats sparse_matrix_multiply_reordered(const non_deduced_t<BasicCSRView<Index, Value>>& A,
+                                               const non_deduced_t<BasicCSRView<Index, Value>>& B,
+                                               BasicCSRMatrix<Index, Value>& C, queue& q, Reordering method,
+                                               MatrixPermutation<Index>* c_perm = nullptr,
+                                               const SpGEMMBinning& binning = SpGEMMBinning());
+
+// Размеры блока, для которых скомпилированы ядра BSR (циклы по блоку раскрываются
+// и векторизуются при компиляции); csr_to_bsr выбирает размер блока из них
+#define BSR_BLOCK_SIZES 1, 2, 3, 4, 6, 8
+
+// Заполнение BSR с блоком block для матрицы A без построения BSR: block^2 * nnzb / nnz(A)
+template <class Index, class Value>
+double bsr_fill_ratio(const BasicCSRView<Index, Value>& A, int block);
+
+// Наибольший размер блока из BSR_BLOCK_SIZES, при котором заполнение не больше max_fill
+// (1 - если блочная структура не найдена)
+template <class Index, class Value>
+int detect_block_size(const BasicCSRView<Index, Value>& A, double max_fill = 1.25);
+
+// Преобразование CSR -> BSR; block == 0 - размер блока выбирается detect_block_size
+template <class Index, class Value>
+BasicBSRMatrix<Index, Value> csr_to_bsr(const BasicCSRView<Index, Value>& A, int block = 0);
+
+template <class Index, class Value>
+BasicBSRMatrix<Index, Value> csr_to_bsr(const BasicCSRMatrix<Index, Value>& A, int block = 0) {
+    return csr_to_bsr(BasicCSRView<Index, Value>(A), block);
+}
+
+// Преобразование BSR -> CSR; элементы блоков с |v| <= eps отбрасываются
+template <class Index, class Value>
+BasicCSRMatrix<Index, Value> bsr_to_csr(const BasicBSRMatrix<Index, Value>& A);
+
+// C = A * B для BSR-матриц с одинаковым размером блока. Блочная структура C строится
+// умножением структур A и B на устройстве (полукольцо OrAnd), затем рабочий элемент на
+// блочную строку C накапливает произведения плотных блоков. Блоки C структурные: блок,
+// все элементы которого сократились, остается в C. Число произведений в статистике -
+// block^3 на пару блоков, nnz_C - число хранимых значений C.
+template <class Index, class Value>
+MultiplyStats sparse_matrix_multiply(const BasicBSRMatrix<Index, Value>& A, const BasicBSRMatrix<Index, Value>& B,
+                                     BasicBSRMatrix<Index, Value>& C, queue& q);
+
+// y = A * x для BSR-матрицы: рабочий элемент на блочную строку, x и y на хосте
+template <class Index, class Value>
+void sparse_matrix_vector_multiply(const BasicBSRMatrix<Index, Value>& A, const std::vector<Value>& x,
+                                   std::vector<Value>& y, queue& q);
+
+// Оценка nnz(A * B) без вычисления произведения: сумма по строкам min(flops строки, B.cols)
+// (upper_bound) или точное число элементов в случайной выборке из samples строк,
+// отнесенное к их flops и умноженное на flops всей матрицы (sampled)
+enum class NnzEstimator { upper_bound, sampled };
+
+template <class Index, class Value>
+size_t estimate_product_nnz(const BasicCSRView<Index, Value>& A, const BasicCSRView<Index, Value>& B,
+                            NnzEstimator estimator = NnzEstimator::sampled, size_t samples = 256,
+                            unsigned seed = 1);
+
+// Порядок умножений цепочки factors[0] * ... * factors[n - 1] с наименьшей оценкой стоимости
+// (flops и nnz промежуточных произведений) в виде расстановки скобок, например "(A0 * (A1 * A2))"
+template <class Index, class Value>
+std::string chain_multiply_order(const std::vector<BasicCSRView<Index, Value>>& factors);
+
+// C = factors[0] * ... * factors[n - 1] в порядке chain_multiply_order. Сомножители
+// копируются на устройство один раз (повторяющиеся массивы - однократно), промежуточные
+// произведения остаются на устройстве; память сомножителя или произведения после
+// последнего использования занимает следующее произведение, рабочие буферы умножений
+// общие для всей цепочки. На хост копируется только C. Статистика суммируется по
+// умножениям цепочки.
+template <class Index, class Value>
+MultiplyStats sparse_matrix_chain_multiply(const std::vector<BasicCSRView<Index, Value>>& factors,
+                                           BasicCSRMatrix<Index, Value>& C, queue& q,
+                                           const SpGEMMBinning& binning = {});
+
+// C = A^k возведением в квадрат по битам k от старшего: floor(log2 k) квадратов и умножение
+// на A для каждого следующего единичного бита. A и промежуточные степени остаются на
+// устройстве в двух чередующихся буферах результата, которые, как и рабочая память,
+// выделяются заново только при росте nnz. A^0 - единичная матрица.
+template <class Index, class Value>
+MultiplyStats sparse_matrix_power(const non_deduced_t<BasicCSRView<Index, Value>>& A, unsigned k,
+                                  BasicCSRMatrix<Index, Value>& C, queue& q, const SpGEMMBinning& binning = {});
+
+// Пул памяти устройства (арена): выделение - сдвиг указателя в заранее выделенном блоке,
+// освобождение - сброс всей арены. Если блока не хватает, добавляется новый, а при сбросе
+// блоки объединяются в один размером пик * growth. Повторяющиеся умножения того же или
+// меньшего размера выделяют память на устройстве только в первых двух вызовах (рост
+// арены и объединение блоков).
+class DeviceArena {
+public:
+    explicit DeviceArena(queue& q, size_t initial_bytes = 0, double growth = 1.25);
+    ~DeviceArena();
+
+    DeviceArena(const DeviceArena&) = delete;
+    DeviceArena& operator=(const DeviceArena&) = delete;
+
+    template <class T>
+    T* allocate(size_t n) {
+        return static_cast<T*>(allocate_bytes(std::max<size_t>(n, 1) * sizeof(T)));
+    }
+
+    // Блок bytes байт, выровненный на alignment (степень двойки)
+    void* allocate_bytes(size_t bytes, size_t alignment = 64);
+
+    // Освобождение всех выделенных блоков; память остается за ареной
+    void reset();
+
+    queue& get_queue() { return q; }
+    size_t reserved_bytes() const;
+    // Наибольший занятый объем с последнего сброса
+    size_t peak_bytes() const { return peak; }
+    // Число обращений к malloc_device за время жизни арены
+    size_t device_allocations() const { return allocations; }
+
+private:
+    struct Chunk {
+        char* data;
+        size_t size;
+    };
+
+    queue q;
+    double growth;
+    std::vector<Chunk> chunks;
+    size_t offset = 0;  // занято в последнем блоке
+    size_t used = 0;    // занято во всех блоках с последнего сброса
+    size_t peak = 0;
+    size_t allocations = 0;
+
+    void add_chunk(size_t bytes);
+};
+
+// Параметры однопроходного умножения. Место под строку i в C резервируется по оценке
+// min(flops_i, cols) (upper_bound, переполнений не бывает) или flops_i * r * slack, где
+// r - отношение nnz к flops на samples случайных строках (sampled).
+struct SinglePassOptions {
+    NnzEstimator estimator = NnzEstimator::sampled;
+    double slack = 1.25;
+    size_t samples = 256;
+};
+
+// Однопроходное C = A * B: одно ядро накапливает строку, сжимает ее и записывает в место,
+// зарезервированное по оценке длины, без отдельного символьного этапа и подсчета nnz до
+// выделения C. Строки, превысившие оценку, остаются в аккумуляторе и переносятся в C
+// вместе с остальными при сжатии C. Вся память устройства (A, B, рабочие буферы, C)
+// берется из арены, которая сбрасывается в начале вызова, а C.col_ind и C.values
+// сохраняют емкость между вызовами. Счетчик overflow_rows - число строк сверх оценки;
+// numeric включает однопроходное ядро и сжатие C.
+template <class Semiring = PlusTimes, class Index, class Value>
+MultiplyStats sparse_matrix_multiply_single_pass(const non_deduced_t<BasicCSRView<Index, Value>>& A,
+                                                 const non_deduced_t<BasicCSRView<Index, Value>>& B,
+                                                 BasicCSRMatrix<Index, Value>& C, DeviceArena& arena,
+                                                 const SinglePassOptions& options = {},
+                                                 const SpGEMMBinning& binning = {});
+
+// Потоковое C = A * B с записью C в двоичный файл CSR. A делится на панели строк так,
+// чтобы B, панель A, рабочая память и панель C (по верхней оценке flops) занимали на
+// устройстве не больше memory_budget байт. Пока вычисляется панель i + 1, панель i
+// записывается в файл отдельным потоком, поэтому на хосте одновременно хранятся две
+// панели C. Строка, не помещающаяся в бюджет, образует отдельную панель. Секция values
+// размещается после места под col_ind по верхней оценке nnz(C) (сумма min(flops, B.cols)
+// по строкам), поэтому col_ind и values каждой панели пишутся сразу на свои места.
+template <class Index, class Value>
+MultiplyStats sparse_matrix_multiply_to_file(const BasicCSRView<Index, Value>& A, const BasicCSRView<Index, Value>& B,
+                                             const std::string& filename, size_t memory_budget, queue& q,
+                                             const SpGEMMBinning& binning = SpGEMMBinning(),
+                                             uint32_t alignment = 4096);
+
+template <class Index, class Value>
+MultiplyStats sparse_matrix_multiply_to_file(const BasicCSRMatrix<Index, Value>& A,
+                                             const BasicCSRMatrix<Index, Value>& B,
+                                             const std::string& filename, size_t memory_budget, queue& q,
+                                             const SpGEMMBinning& binning = SpGEMMBinning(),
+                                             uint32_t alignment = 4096) {
+    return sparse_matrix_multiply_to_file(BasicCSRView<Index, Value>(A), BasicCSRView<Index, Value>(B), filename,
+                                          memory_budget, q, binning, alignment);
+}
+
+// Среднее число элементов в строке, начиная с которого SpMV/SpMM назначает строке подгруппу
+#define SPMV_VECTOR_ROW_MIN 16
+// Число векторов X, обрабатываемых за один проход по строке A в SpMM: индекс столбца
+// и значение A загружаются один раз на SPMM_BLOCK соседних элементов строки X
+#define SPMM_BLOCK 8
+
+// Распределение строк в SpMV/SpMM: рабочий элемент на строку (scalar), подгруппа на строку
+// (vector) или выбор по средней длине строки (automatic)
+enum class SpMVKernel { automatic, scalar, vector };
+
+// y = A * x для матрицы и векторов в памяти устройства (x длины A.cols, y длины A.rows)
+template <class Index, class Value>
+void sparse_matrix_vector_multiply(const BasicDeviceCSRMatrix<Index, Value>& A, const Value* x, Value* y,
+                                   queue& q, SpMVKernel kernel = SpMVKernel::automatic);
+
+// Y = A * X для k векторов, хранящихся по строкам: X - A.cols x k, Y - A.rows x k
+template <class Index, class Value>
+void sparse_matrix_dense_multiply(const BasicDeviceCSRMatrix<Index, Value>& A, const Value* X, Value* Y, size_t k,
+                                  queue& q, SpMVKernel kernel = SpMVKernel::automatic);
+
+// То же для матрицы и векторов на хосте: данные копируются на устройство и обратно
+template <class Index, class Value>
+void sparse_matrix_vector_multiply(const BasicCSRView<Index, Value>& A, const std::vector<Value>& x,
+                                   std::vector<Value>& y, queue& q, SpMVKernel kernel = SpMVKernel::automatic);
+
+template <class Index, class Value>
+void sparse_matrix_vector_multiply(const BasicCSRMatrix<Index, Value>& A, const std::vector<Value>& x,
+                                   std::vector<Value>& y, queue& q, SpMVKernel kernel = SpMVKernel::automatic) {
+    sparse_matrix_vector_multiply(BasicCSRView<Index, Value>(A), x, y, q, kernel);
+}
+
+template <class Index, class Value>
+void sparse_matrix_dense_multiply(const BasicCSRView<Index, Value>& A, const std::vector<Value>& X,
+                                  std::vector<Value>& Y, size_t k, queue& q,
+                                  SpMVKernel kernel = SpMVKernel::automatic);
+
+template <class Index, class Value>
+void sparse_matrix_dense_multiply(const BasicCSRMatrix<Index, Value>& A, const std::vector<Value>& X,
+                                  std::vector<Value>& Y, size_t k, queue& q,
+                                  SpMVKernel kernel = SpMVKernel::automatic) {
+    sparse_matrix_dense_multiply(BasicCSRView<Index, Value>(A), X, Y, k, q, kernel);
+}
+
+// Векторизованные SpMV/SpMM на хосте: строки делятся между потоками (0 - по числу ядер)
+// поровну по числу ненулевых элементов, внутренние циклы векторизуются (omp simd)
+template <class Index, class Value>
+void sparse_matrix_vector_multiply_host(const BasicCSRView<Index, Value>& A, const Value* x, Value* y,
+                                        unsigned num_threads = 0);
+
+template <class Index, class Value>
+void sparse_matrix_dense_multiply_host(const BasicCSRView<Index, Value>& A, const Value* X, Value* Y, size_t k,
+                                       unsigned num_threads = 0);
\ No newline at end of file
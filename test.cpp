@@ -1,12 +1,53 @@
 #include "func.hpp"
 
+// Эталонное C = A * B на хосте над полукольцом Semiring: плотный аккумулятор строки
+template <class Semiring>
+static CSRMatrix reference_multiply(const CSRMatrix& A, const CSRMatrix& B) {
+    CSRMatrix C(A.rows, B.cols);
+    std::vector<double> acc(B.cols);
+    std::vector<char> used(B.cols, 0);
+    for (int i = 0; i < A.rows; i++) {
+        for (int p = A.row_ptr[i]; p < A.row_ptr[i + 1]; p++) {
+            int k = A.col_ind[p];
+            for (int r = B.row_ptr[k]; r < B.row_ptr[k + 1]; r++) {
+                int j = B.col_ind[r];
+                double product = Semiring::multiply(A.values[p], B.values[r]);
+                acc[j] = used[j] ? Semiring::add(acc[j], product) : product;
+                used[j] = 1;
+            }
+        }
+        for (int j = 0; j < B.cols; j++) {
+            if (used[j] && Semiring::keep(acc[j])) {
+                C.col_ind.push_back(j);
+                C.values.push_back(Semiring::has_values ? acc[j] : 1.0);
+            }
+            used[j] = 0;
+        }
+        C.row_ptr[i + 1] = C.col_ind.size();
+    }
+    C.non_zero_el = C.col_ind.size();
+    return C;
+}
+
+// Умножение над полукольцом Semiring (обычное и однопроходное) в сравнении с эталоном на хосте
+template <class Semiring>
+static bool check_semiring(const CSRMatrix& A, const CSRMatrix& B, queue& q) {
+    CSRMatrix expected = reference_multiply<Semiring>(A, B);
+    CSRMatrix C, C_single;
+    sparse_matrix_multiply<Semiring>(A, B, C, q);
+    DeviceArena arena(q);
+    sparse_matrix_multiply_single_pass<Semiring>(A, B, C_single, arena);
+    return same_matrix(C, expected) && same_matrix(C_single, expected);
+}
+
 int main() 
 {
     std::cout << "Enter file name: ";
     std::string filename;
     std::cin >> filename;
-    CSRMatrix A = read_matrix_from_file(filename);
-    CSRMatrix B = read_matrix_from_file(filename);
+    bool matrix_market = filename.size() > 4 && filename.compare(filename.size() - 4, 4, ".mtx") == 0;
+    CSRMatrix A = matrix_market ? read_matrix_market(filename) : read_matrix_from_file(filename);
+    CSRMatrix B = A;
     CSRMatrix AT;
     sparse_matrix_t A_csr_mkl = nullptr;
     sparse_matrix_t B_csr_mkl = nullptr;
@@ -49,7 +90,7 @@ int main()
                     std::cout << "CPU exception: " << e.what() << std::endl;
                 }
             }
-        });
+        }, property_list{property::queue::enable_profiling()});
 
         // Создаем очередь для NVIDIA GPU
         queue gpu_queue(nvidia_selector, [](exception_list e_list) {
@@ -64,10 +105,11 @@ int main()
 
         auto start = std::chrono::high_resolution_clock::now();
         CSRMatrix C_csr_cpu;
-        sparse_matrix_multiply(A, B, C_csr_cpu, cpu_queue);
+        MultiplyStats stats = sparse_matrix_multiply(A, B, C_csr_cpu, cpu_queue);
         auto end = std::chrono::high_resolution_clock::now();
         auto res = std::chrono::duration<double>(end - start).count();
         std::cout << "CSR CPU result: " << res << std::endl;
+        stats.print();
 
         // start = std::chrono::high_resolution_clock::now();
         // CSRMatrix C_csr_gpu;
@@ -147,7 +189,8 @@ int main()
         }
         for (int i = 0; i < C_csr_cpu.values.size(); i++) {
             //std::cout << values[i] << " " << C_csr_cpu.values[i] << std::endl;
-            if (abs(values[i] - C_csr_cpu.values[i]) > eps) {
+            // Порядок сложения в строках, накапливаемых группой, не фиксирован - сравнение относительное
+            if (std::fabs(values[i] - C_csr_cpu.values[i]) > eps * std::max(1.0, std::fabs(values[i]))) {
                 correct = false;
                 std::cout << "V: cpu " << std::fixed << std::setprecision(0)<< C_csr_cpu.values[i] << " mkl " << std::fixed << std::setprecision(0) << values[i] << " i " << i << std::endl;
                 break;
@@ -160,6 +203,179 @@ int main()
             std::cout << "Results aren't correct!" << std::endl;
         }
 
+        // Умножение на подустройствах CPU по доменам NUMA в сравнении с одной очередью
+        std::vector<queue> numa_queues = make_numa_queues(cpu_queue.get_device(), true);
+        start = std::chrono::high_resolution_clock::now();
+        CSRMatrix C_csr_numa;
+        sparse_matrix_multiply(A, B, C_csr_numa, numa_queues);
+        end = std::chrono::high_resolution_clock::now();
+        std::cout << "CSR CPU NUMA result (" << numa_queues.size() << " sub-devices): "
+                  << std::chrono::duration<double>(end - start).count() << std::endl;
+        bool numa_correct = same_matrix(C_csr_numa, C_csr_cpu);
+        std::cout << (numa_correct ? "NUMA results are correct!" : "NUMA results aren't correct!") << std::endl;
+
+        // Потоковое умножение с записью C в двоичный файл: бюджет памяти - B и четверть
+        // оценки остальной памяти умножения, чтобы A делилась на несколько панелей
+        const std::string stream_filename = "test_stream_C.bin";
+        size_t b_bytes = (B.rows + 1) * sizeof(int) + B.col_ind.size() * (sizeof(int) + sizeof(double));
+        size_t rest_bytes = (A.rows + 1) * sizeof(int) + A.col_ind.size() * (sizeof(int) + sizeof(double)) +
+                            stats.peak_scratch_bytes + C_csr_cpu.col_ind.size() * (sizeof(int) + sizeof(double));
+        start = std::chrono::high_resolution_clock::now();
+        MultiplyStats stream_stats = sparse_matrix_multiply_to_file(A, B, stream_filename, b_bytes + rest_bytes / 4 + 1,
+                                                                    cpu_queue);
+        end = std::chrono::high_resolution_clock::now();
+        std::cout << "CSR CPU to file result (" << stream_stats.panels << " panels): "
+                  << std::chrono::duration<double>(end - start).count() << std::endl;
+        bool stream_correct = same_matrix(MappedCSRMatrix(stream_filename).to_matrix(), C_csr_cpu);
+        std::remove(stream_filename.c_str());
+        std::cout << (stream_correct ? "File results are correct!" : "File results aren't correct!") << std::endl;
+
+        // Полукольца: OrAnd на A с единичными значениями (сложение без сокращений) дает
+        // структуру обычного произведения; все полукольца сравниваются с эталоном на хосте
+        CSRMatrix A_ones = A;
+        std::fill(A_ones.values.begin(), A_ones.values.end(), 1.0);
+        CSRMatrix C_plus, C_or;
+        sparse_matrix_multiply(A_ones, A_ones, C_plus, cpu_queue);
+        sparse_matrix_multiply<OrAnd>(A_ones, A_ones, C_or, cpu_queue);
+        bool semiring_correct = C_or.row_ptr == C_plus.row_ptr && C_or.col_ind == C_plus.col_ind &&
+                                std::all_of(C_or.values.begin(), C_or.values.end(), [](double v) { return v == 1.0; });
+
+        CSRMatrix G = generate_uniform_random(300, 300, 0.02, 7);
+        semiring_correct = semiring_correct && check_semiring<PlusTimes>(G, G, cpu_queue) &&
+                           check_semiring<MinPlus>(G, G, cpu_queue) && check_semiring<MaxTimes>(G, G, cpu_queue) &&
+                           check_semiring<OrAnd>(G, G, cpu_queue);
+        std::cout << (semiring_correct ? "Semiring results are correct!" : "Semiring results aren't correct!")
+                  << std::endl;
+
+        // Степень и цепочка на устройстве в сравнении с последовательными умножениями
+        CSRMatrix G2, G3, G4, C_power, C_chain;
+        sparse_matrix_multiply(G, G, G2, cpu_queue);
+        sparse_matrix_multiply(G2, G, G3, cpu_queue);
+        sparse_matrix_multiply(G3, G, G4, cpu_queue);
+        sparse_matrix_power(G, 4, C_power, cpu_queue);
+        CSRMatrix R = generate_uniform_random(40, 300, 0.05, 11);
+        CSRMatrix RG, RGRT;
+        CSRMatrix RT = R.transpose();
+        sparse_matrix_multiply(R, G, RG, cpu_queue);
+        sparse_matrix_multiply(RG, RT, RGRT, cpu_queue);
+        sparse_matrix_chain_multiply({CSRView(R), CSRView(G), CSRView(RT)}, C_chain, cpu_queue);
+        bool chain_correct = same_matrix(C_power, G4) && same_matrix(C_chain, RGRT);
+        sparse_matrix_power(G, 3, C_power, cpu_queue);
+        chain_correct = chain_correct && same_matrix(C_power, G3);
+        std::cout << (chain_correct ? "Chain results are correct!" : "Chain results aren't correct!") << std::endl;
+
+        // План умножения: после изменения значений A на месте численный этап дает то же, что
+        // полное умножение (положительные значения - без сокращений), а шаблон C не копируется
+        CSRMatrix A_plan = G;
+        CSRMatrix B_plan = generate_uniform_random(300, 200, 0.02, 13);
+        SpGEMMPlan plan(A_plan, B_plan, cpu_queue);
+        CSRMatrix C_plan, C_full;
+        plan.execute(A_plan, B_plan, C_plan);
+        sparse_matrix_multiply(A_plan, B_plan, C_full, cpu_queue);
+        bool plan_correct = same_matrix(C_plan, C_full);
+        const int* plan_col_ind = C_plan.col_ind.data();
+        for (size_t i = 0; i < A_plan.values.size(); i++) {
+            A_plan.values[i] = 0.5 + (i % 5) * 0.25;
+        }
+        plan.execute(A_plan, B_plan, C_plan);
+        sparse_matrix_multiply(A_plan, B_plan, C_full, cpu_queue);
+        plan_correct = plan_correct && same_matrix(C_plan, C_full) && C_plan.col_ind.data() == plan_col_ind;
+        std::cout << (plan_correct ? "Plan results are correct!" : "Plan results aren't correct!") << std::endl;
+
+        // Асинхронное умножение: значения A заполняются ядром в памяти USM, событие ядра
+        // передается как зависимость копирования A на устройство
+        size_t async_nnz = G.values.size();
+        double* async_values = malloc_shared<double>(async_nnz, cpu_queue);
+        event filled = cpu_queue.parallel_for(range<1>(async_nnz), [=](id<1> i) {
+            async_values[i] = 0.5 + (i[0] % 5) * 0.25;
+        });
+        CSRView G_async(G.rows, G.cols, async_nnz, G.row_ptr.data(), G.col_ind.data(), async_values);
+        CSRMatrix C_async, G_sync = G, C_sync;
+        auto async_result = sparse_matrix_multiply_async(G_async, G_async, C_async, cpu_queue, {filled});
+        for (size_t i = 0; i < async_nnz; i++) {
+            G_sync.values[i] = 0.5 + (i % 5) * 0.25;
+        }
+        sparse_matrix_multiply(G_sync, G_sync, C_sync, cpu_queue);
+        async_result.get();
+        free(async_values, cpu_queue);
+        bool async_correct = same_matrix(C_async, C_sync);
+        std::cout << (async_correct ? "Async results are correct!" : "Async results aren't correct!") << std::endl;
+
+        // 64-битные индексы и значения одинарной точности в сравнении с умножением в double;
+        // значения G положительны, поэтому допуск относительный с точностью float
+        BasicCSRMatrix<int64_t, float> G64 = G.cast<int64_t, float>();
+        BasicCSRMatrix<int64_t, float> C64;
+        CSRMatrix C_double;
+        sparse_matrix_multiply(G64, G64, C64, cpu_queue);
+        sparse_matrix_multiply(G, G, C_double, cpu_queue);
+        bool types_correct = same_matrix(C64.cast<int, double>(), C_double, 1e-5);
+        std::cout << (types_correct ? "int64/float results are correct!" : "int64/float results aren't correct!")
+                  << std::endl;
+
+        // SpMV и SpMM (k векторов, хранящихся по строкам) в сравнении с mkl_sparse_d_mv/mm
+        const size_t k = 8;
+        std::vector<double> x(A.cols), X(static_cast<size_t>(A.cols) * k);
+        for (size_t i = 0; i < x.size(); i++) {
+            x[i] = 1.0 + (i % 7) * 0.125;
+        }
+        for (size_t i = 0; i < X.size(); i++) {
+            X[i] = 1.0 + (i % 11) * 0.0625;
+        }
+        std::vector<double> y, Y;
+        std::vector<double> y_host(A.rows), Y_host(static_cast<size_t>(A.rows) * k);
+        std::vector<double> y_mkl(A.rows), Y_mkl(static_cast<size_t>(A.rows) * k);
+        matrix_descr descr;
+        descr.type = SPARSE_MATRIX_TYPE_GENERAL;
+
+        // Максимальное относительное расхождение с результатом MKL
+        auto max_error = [](const std::vector<double>& u, const std::vector<double>& v) {
+            double err = 0;
+            for (size_t i = 0; i < u.size(); i++) {
+                err = std::max(err, std::fabs(u[i] - v[i]) / std::max(1.0, std::fabs(v[i])));
+            }
+            return err;
+        };
+
+        start = std::chrono::high_resolution_clock::now();
+        sparse_matrix_vector_multiply(A, x, y, cpu_queue);
+        end = std::chrono::high_resolution_clock::now();
+        std::cout << "SpMV CPU result: " << std::chrono::duration<double>(end - start).count() << std::endl;
+
+        start = std::chrono::high_resolution_clock::now();
+        sparse_matrix_vector_multiply_host(CSRView(A), x.data(), y_host.data());
+        end = std::chrono::high_resolution_clock::now();
+        std::cout << "SpMV host result: " << std::chrono::duration<double>(end - start).count() << std::endl;
+
+        start = std::chrono::high_resolution_clock::now();
+        mkl_sparse_d_mv(SPARSE_OPERATION_NON_TRANSPOSE, 1.0, A_csr_mkl, descr, x.data(), 0.0, y_mkl.data());
+        end = std::chrono::high_resolution_clock::now();
+        std::cout << "MKL SpMV result: " << std::chrono::duration<double>(end - start).count() << std::endl;
+
+        start = std::chrono::high_resolution_clock::now();
+        sparse_matrix_dense_multiply(A, X, Y, k, cpu_queue);
+        end = std::chrono::high_resolution_clock::now();
+        std::cout << "SpMM CPU result: " << std::chrono::duration<double>(end - start).count() << std::endl;
+
+        start = std::chrono::high_resolution_clock::now();
+        sparse_matrix_dense_multiply_host(CSRView(A), X.data(), Y_host.data(), k);
+        end = std::chrono::high_resolution_clock::now();
+        std::cout << "SpMM host result: " << std::chrono::duration<double>(end - start).count() << std::endl;
+
+        start = std::chrono::high_resolution_clock::now();
+        mkl_sparse_d_mm(SPARSE_OPERATION_NON_TRANSPOSE, 1.0, A_csr_mkl, descr, SPARSE_LAYOUT_ROW_MAJOR,
+                        X.data(), k, k, 0.0, Y_mkl.data(), k);
+        end = std::chrono::high_resolution_clock::now();
+        std::cout << "MKL SpMM result: " << std::chrono::duration<double>(end - start).count() << std::endl;
+
+        double spmv_error = std::max(max_error(y, y_mkl), max_error(y_host, y_mkl));
+        double spmm_error = std::max(max_error(Y, Y_mkl), max_error(Y_host, Y_mkl));
+        std::cout << "SpMV/SpMM max relative error: " << spmv_error << " / " << spmm_error << std::endl;
+        if (spmv_error > eps || spmm_error > eps) {
+            std::cout << "SpMV/SpMM results aren't correct!" << std::endl;
+        } else {
+            std::cout << "SpMV/SpMM results are correct!" << std::endl;
+        }
+
         if (A_csr_mkl != nullptr) {
             mkl_sparse_destroy(A_csr_mkl);
         }